@@ -5,9 +5,11 @@
  *
  ***************************************************************************/
 
+#ifndef hd_Candidates
+#define hd_Candidates
+
 #include <vector>
 #include <iostream>
-#include <sstream>
 #include <string>
 
 #include <inttypes.h>
@@ -16,34 +18,53 @@
 #endif
 #include <time.h>
 
-class Candidate 
+#include "hd/CandidateFrame.h"
+
+// Max sample separation for coincidence between candidates whose larger
+// filter index is filter
+int64_t coincidence_time_tolerance (unsigned filter);
+
+// Candidates of one beam, stored by value column by column
+class BeamCandidates
 {
   public:
 
-    Candidate (); 
-    Candidate (const char * line, unsigned _beam_number);
-    ~Candidate ();
-
-    void header();
-
-    bool is_coincident(const Candidate * c);
-
-    friend std::ostream& operator<<(std::ostream& os, const Candidate * c);
-
-    float         snr;
-    int64_t       sample_idx;
-    float         sample_time;
-    unsigned int  filter;
-    unsigned int  dm_trial;
-    float         dm;
-    unsigned int  members;
-    int64_t       begin;
-    int64_t       end;
-    unsigned      nbeams;
-    unsigned      beam_mask;
-    unsigned int  primary_beam;
-    float         max_snr;
-    unsigned int  beam;
+    BeamCandidates (unsigned _beam_number=0) : beam_number(_beam_number) {}
+
+    size_t size() const { return snr.size(); }
+    void reserve (size_t n);
+
+    // Parses the tab-separated .cand lines in [first, last), returning
+    // false if a line is malformed
+    bool parse (const char * first, const char * last);
+    void add (const CandidateRecord& record);
+
+    // Writes candidate i in the coincidencer output format
+    void write (std::ostream& os, size_t i) const;
+
+    bool is_coincident (size_t i, const BeamCandidates& other, size_t j) const;
+
+    unsigned int  beam_number;
+
+    std::vector<float>         snr;
+    std::vector<int64_t>       sample_idx;
+    std::vector<float>         sample_time;
+    std::vector<unsigned int>  filter;
+    std::vector<unsigned int>  dm_trial;
+    std::vector<float>         dm;
+    std::vector<unsigned int>  members;
+    std::vector<int64_t>       begin;
+    std::vector<int64_t>       end;
+    std::vector<unsigned int>  nbeams;
+    std::vector<unsigned int>  beam_mask;
+    std::vector<unsigned int>  primary_beam;
+    std::vector<float>         max_snr;
+
+  private:
+
+    void push_back (float _snr, int64_t _sample_idx, float _sample_time,
+                    unsigned _filter, unsigned _dm_trial, float _dm,
+                    unsigned _members, int64_t _begin, int64_t _end);
 };
 
 class CandidateChunk 
@@ -56,13 +77,15 @@ class CandidateChunk
 
     void addBeam(std::string _utc_start, std::string _first_sample_utc, 
                  uint64_t _first_sample, unsigned int beam,
-                 uint64_t num_events, std::istringstream& ss);
+                 uint64_t num_events, const CandidateRecord* records);
 
     void resize (unsigned _n_beams);
 
     unsigned int get_n_beams() const;
 
-    void compute_coincidence();
+    // Fills in the multi-beam fields of every candidate, using up to
+    // nthreads threads (one beam per thread at a time)
+    void compute_coincidence(unsigned nthreads=1);
 
     void write_coincident_candidates();
 
@@ -74,9 +97,7 @@ class CandidateChunk
 
   private:
 
-    std::vector<std::vector<Candidate *> > cands;
-
-    std::vector<unsigned int> beam_numbers;
+    std::vector<BeamCandidates> beams;
 
     unsigned int n_beams;
 
@@ -93,3 +114,4 @@ class CandidateChunk
 
 };
 
+#endif
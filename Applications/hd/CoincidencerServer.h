@@ -0,0 +1,117 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#ifndef hd_CoincidencerServer
+#define hd_CoincidencerServer
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "hd/Candidates.h"
+#include "hd/ServerSocket.h"
+#include "hd/CandidateFrameReader.h"
+#include "hd/ThreadPool.h"
+
+// Receives candidate frames from many beams at once on a single epoll loop,
+//   assembles them into chunks by first sample, and hands each completed
+//   chunk to a worker pool for the coincidence computation and output
+// Gulps sent with CANDFRAME_FLAG_ACK are acknowledged from the loop once the
+//   worker has written their chunk
+class CoincidencerServer
+{
+  public:
+
+    CoincidencerServer (const char * address, int port, unsigned total_beams,
+                        unsigned max_chunks_to_wait, unsigned nthreads,
+                        unsigned verbose);
+    ~CoincidencerServer ();
+
+    // Runs the event loop until quit becomes non-zero
+    void run (const volatile int& quit);
+
+  private:
+
+    struct Connection
+    {
+      std::unique_ptr<ServerSocket> socket;
+      CandidateFrameReader          reader;
+      uint64_t                      id;   // fds are reused, ids are not
+      // Replies not yet accepted by the socket
+      std::vector<char>             outbox;
+      bool                          watching_output;
+      // Set instead of closing while the connection may be in use; the
+      //   event loop closes it once it is done with it
+      bool                          closing;
+      Connection () : id (0), watching_output (false), closing (false) {}
+    };
+
+    // A gulp to be acknowledged once its chunk has been written
+    struct AckTarget
+    {
+      int      fd;
+      uint64_t connection_id;
+      uint32_t beam;
+    };
+
+    struct PendingChunk
+    {
+      CandidateChunk *       chunk;
+      std::vector<AckTarget> acks;
+    };
+
+    struct CompletedChunk
+    {
+      uint64_t               first_sample;
+      unsigned               nbeams;
+      std::vector<AckTarget> acks;
+    };
+
+    void accept_connections ();
+    // Returns false once the connection should be closed
+    bool read_connection (int fd, Connection& connection);
+    // Sends as much of the outbox as the socket takes without blocking
+    void flush_connection (int fd, Connection& connection);
+    void close_connection (int fd);
+    void close_closing_connections ();
+
+    void add_gulp (const CandidateGulpHeader& gulp, const CandidateRecord * records,
+                   const AckTarget * ack);
+    void emit_chunk (std::map<uint64_t, PendingChunk>::iterator chunk);
+
+    // Sends the acknowledgements of chunks the workers have finished
+    void send_acks ();
+    // Queues a reply to the beam; never closes the connection
+    void send_ack (const AckTarget& target, uint16_t type, uint64_t first_sample,
+                   unsigned nbeams);
+
+    ServerSocket                          m_server;
+    int                                   m_epoll_fd;
+    std::map<int, Connection>             m_connections;
+    uint64_t                              m_next_connection_id;
+    std::map<uint64_t, PendingChunk>      m_chunks;
+    std::vector<char>                     m_recv_buffer;
+    std::vector<char>                     m_ack_buffer;
+
+    // Workers queue finished chunks here and signal the loop via m_event_fd
+    int                                   m_event_fd;
+    std::mutex                            m_completed_mutex;
+    std::vector<CompletedChunk>           m_completed;
+
+    unsigned                              m_total_beams;
+    unsigned                              m_max_chunks_to_wait;
+    unsigned                              m_verbose;
+
+    // Gulps for new chunks at or before this sample arrive too late
+    bool                                  m_emitted_any;
+    uint64_t                              m_last_emitted;
+
+    std::unique_ptr<ThreadPool>           m_pool;
+};
+
+#endif
@@ -0,0 +1,98 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#ifndef __AsyncSigprocFile_h
+#define __AsyncSigprocFile_h
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <config.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "hd/SigprocFile.h"
+
+// A SigprocFile that keeps queue_depth aligned reads of block_size bytes in
+//   flight ahead of the pipeline, bypassing the page cache with O_DIRECT
+//   where the file system allows it
+// The reads are made with io_uring if heimdall was built with liburing and
+//   the kernel supports it, and otherwise by a pool of threads calling pread
+class AsyncSigprocFile: public SigprocFile
+{
+  public:
+
+    AsyncSigprocFile (const char* filename, bool fswap, unsigned queue_depth,
+                      size_t block_size = 4 << 20);
+    ~AsyncSigprocFile ();
+
+    // MB delivered per second since the file was opened
+    double get_read_rate () const;
+    // Time spent waiting for reads to complete
+    double get_wait_seconds () const { return m_wait.count(); }
+    bool   is_direct () const { return m_direct; }
+    bool   is_io_uring () const { return m_use_uring; }
+
+    // The first reads are already in flight, and bypass the page cache
+    void   prefetch (size_t /*nsamps*/) {}
+
+  protected:
+
+    size_t read_samples (size_t nsamps, char* data);
+
+  private:
+
+    struct Slot
+    {
+      char *   buffer;
+      uint64_t block;      // Block of the file being read into buffer
+      ssize_t  result;     // Bytes read, or -errno
+      bool     in_flight;
+      bool     done;
+    };
+
+    // Starts reading the next block of the file into slot
+    void submit (unsigned slot);
+    // Returns once the read into slot has completed
+    void wait (unsigned slot);
+    void pread_worker ();
+    // Reads whatever the last read into slot fell short of
+    void complete (Slot& slot);
+
+    int               m_fd;
+    bool              m_direct;
+    size_t            m_block_size;
+    uint64_t          m_file_size;
+    std::vector<Slot> m_slots;
+    uint64_t          m_next_block;  // Next block to submit
+    uint64_t          m_position;    // File offset of the next byte to deliver
+
+    bool              m_use_uring;
+#ifdef HAVE_LIBURING
+    struct io_uring   m_ring;
+#endif
+
+    // pread pool, used without io_uring
+    std::vector<std::thread> m_workers;
+    std::mutex               m_mutex;
+    std::condition_variable  m_requested;
+    std::condition_variable  m_completed;
+    std::deque<unsigned>     m_requests;
+    bool                     m_stop;
+
+    uint64_t                                 m_bytes_delivered;
+    std::chrono::steady_clock::time_point    m_start;
+    std::chrono::duration<double>            m_wait;
+};
+
+#endif
@@ -0,0 +1,169 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+/*
+  Append-only binary candidate log, one per observation.
+
+  Layout of <name>.candlog:
+    CandidateLogHeader
+    for each gulp:
+      CandidateLogBlock
+      count values of each column, in the order of CandidateColumns
+
+  Every candidate occupies CANDLOG_RECORD_SIZE bytes, stored column by
+    column within its gulp's block. The sidecar <name>.candlog.idx holds a
+    copy of each CandidateLogBlock, appended only once the block itself has
+    been synced, so that a reader can seek straight to any gulp. If the
+    index is missing or short (e.g., after a crash) the reader recovers the
+    blocks by walking the log instead.
+
+  All values are little-endian, as written by the host.
+ */
+
+#ifndef __CandidateLog_h
+#define __CandidateLog_h
+
+#include <stdint.h>
+#include <time.h>
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <iosfwd>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+
+#define CANDLOG_MAGIC   "HDCANDLG"
+#define CANDLOG_VERSION 1
+
+struct CandidateLogHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t beam;        // 0-based beam number
+  int64_t  utc_start;   // UTC time of the first sample
+  double   dt;          // Sampling time (s)
+  uint32_t record_size; // Bytes per candidate, summed over the columns
+  uint32_t reserved[7];
+};
+
+struct CandidateLogBlock
+{
+  uint64_t offset;      // Byte offset of this block in the log
+  uint64_t first_idx;   // First sample of the gulp
+  int64_t  utc;         // UTC time of first_idx
+  uint64_t count;       // No. candidates in the block
+};
+
+// Columns of a block of candidates; sample indices are absolute
+struct CandidateColumns
+{
+  std::vector<float>    snr;
+  std::vector<uint64_t> samp;
+  std::vector<uint32_t> filter;
+  std::vector<uint32_t> dm_trial;
+  std::vector<float>    dm;
+  std::vector<uint32_t> members;
+  std::vector<uint64_t> begin;
+  std::vector<uint64_t> end;
+
+  size_t size() const { return snr.size(); }
+  void   resize (size_t count);
+  void   clear () { resize(0); }
+};
+
+enum { CANDLOG_RECORD_SIZE = 2*sizeof(float) + 3*sizeof(uint32_t) + 3*sizeof(uint64_t) };
+
+// Writes the candidates in the tab-separated .cand text format
+void write_candidate_text (std::ostream& os, const CandidateColumns& columns,
+                           double dt);
+
+// Writes blocks from a background thread, so that the pipeline only pays
+//   for handing over its columns
+// Note: The log and index are synced every sync_blocks blocks, or when
+//         sync_seconds have passed since the last sync, whichever is first
+class CandidateLogWriter
+{
+  public:
+
+    CandidateLogWriter (const char* filename, const CandidateLogHeader& header,
+                        unsigned sync_blocks=32, double sync_seconds=10);
+    ~CandidateLogWriter ();
+
+    // True once a block has failed to be written or synced; any blocks
+    //   appended since are dropped
+    bool get_error() const { return m_error != 0; }
+
+    // Queues a gulp's candidates; columns is left empty
+    void append (uint64_t first_idx, time_t utc, CandidateColumns& columns);
+
+    // Writes out everything queued, syncs and stops the writer thread
+    void close ();
+
+  private:
+
+    struct Pending {
+      CandidateLogBlock block;
+      CandidateColumns  columns;
+    };
+
+    void run ();
+    bool write_block (Pending& pending);
+    bool sync ();
+
+    std::string             m_filename;
+    int                     m_fd;
+    int                     m_idx_fd;
+    std::atomic<int>        m_error;
+    uint64_t                m_offset;
+    unsigned                m_sync_blocks;
+    std::chrono::duration<double> m_sync_interval;
+
+    std::thread             m_thread;
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Pending>     m_queue;
+    bool                    m_closing;
+
+    // Written but not yet synced, so not yet in the index
+    std::vector<CandidateLogBlock>        m_unsynced;
+    std::chrono::steady_clock::time_point m_last_sync;
+};
+
+class CandidateLogReader
+{
+  public:
+
+    CandidateLogReader (const char* filename);
+    ~CandidateLogReader ();
+
+    bool get_error() const { return m_error != 0; }
+
+    const CandidateLogHeader& get_header() const { return m_header; }
+    size_t get_block_count() const { return m_blocks.size(); }
+    const CandidateLogBlock& get_block(size_t i) const { return m_blocks[i]; }
+
+    // Reads the candidates of block i
+    bool read_block (size_t i, CandidateColumns& columns);
+
+  private:
+
+    bool load_index (const std::string& filename);
+    void scan_blocks ();
+
+    std::ifstream                  m_file_stream;
+    uint64_t                       m_file_size;
+    int                            m_error;
+    CandidateLogHeader             m_header;
+    std::vector<CandidateLogBlock> m_blocks;
+};
+
+#endif
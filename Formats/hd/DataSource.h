@@ -30,6 +30,7 @@ class DataSource {
 
     size_t get_nchan() const { return nchan; }
     size_t get_nbit()  const { return nbit; }
+    size_t get_npol()  const { return npol; }
     size_t get_stride() const { return stride; }
     size_t get_beam()   const { return beam; }
     time_t get_utc_start()  const { return utc_start; }
@@ -42,6 +43,18 @@ class DataSource {
     virtual bool   get_error() const = 0;
     virtual size_t get_data(size_t nsamps, char* data) = 0;
 
+    // Sources that hold their data in memory, and need not transform it, can
+    //   instead hand out read-only views of nsamps from first_sample on,
+    //   returning the no. samples viewed
+    // Note: A view is valid until the next call, which may release the data
+    //         before its first_sample
+    virtual bool   supports_views() const { return false; }
+    virtual size_t get_view(size_t /*first_sample*/, size_t /*nsamps*/,
+                            const char*& /*data*/) { return 0; }
+    // The most samples a single view can hold; larger requests must be
+    //   read with get_data instead
+    virtual size_t get_max_view() const { return (size_t) -1; }
+
     static time_t mjd2utctm (double mjd)
     {
       const int seconds_in_day = 86400;
@@ -0,0 +1,57 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#ifndef __IngestReducer_h
+#define __IngestReducer_h
+
+#include <vector>
+#include <memory>
+
+#include "hd/DataSource.h"
+
+// Wraps another source to sum its polarisations and add together tscrunch
+//   samples and fscrunch channels as the data are unpacked, so that all
+//   later processing works on the reduced filterbank
+// The polarisations of each sample are expected one spectrum after another
+// Sums are scaled to the full range of the output, which is 8-bit for
+//   inputs of up to 8 bits and 16-bit for 16-bit inputs
+class IngestReducer : public DataSource
+{
+  public:
+
+    // Takes ownership of source; the work is split over nthreads threads
+    IngestReducer (DataSource* source, unsigned tscrunch, unsigned fscrunch,
+                   unsigned nthreads = 1);
+
+    bool   get_error() const { return m_error || m_source->get_error(); }
+    size_t get_data (size_t nsamps, char* data);
+
+    DataSource * get_source () { return m_source.get(); }
+
+  private:
+
+    // Reduces nsamps output samples from in into out
+    void   reduce (const char* in, size_t nsamps, char* out) const;
+
+    std::unique_ptr<DataSource> m_source;
+    unsigned  m_tscrunch;
+    unsigned  m_fscrunch;
+    unsigned  m_nthreads;
+    bool      m_error;
+
+    size_t    m_in_nchan;
+    size_t    m_in_npol;
+    size_t    m_in_nbit;
+    size_t    m_in_stride;
+    float     m_scale;      // From the sum of inputs to the output range
+
+    size_t    m_position;   // Next input sample, when viewing the source
+    std::vector<char> m_raw;
+    size_t    m_carry;      // Input samples left in m_raw from the last read
+};
+
+#endif
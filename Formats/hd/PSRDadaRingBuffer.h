@@ -5,15 +5,24 @@
  *
  ***************************************************************************/
 
+#include <vector>
+
 #include "dada_hdu.h"
 
 #include "hd/DataSource.h"
 
+// With use_blocks, the data are handed out as views straight into the
+//   blocks of the ring buffer, each released once no view can reach it
+// Only one block may be open for reading at a time, so a view that starts
+//   before the open block is assembled from a copy of the samples kept back
+//   from the blocks before it; views only avoid copies for gulps smaller
+//   than a block
+// Note: get_data must not be mixed with views
 class PSRDadaRingBuffer : public DataSource {
 
   public:
 
-     PSRDadaRingBuffer (key_t dada_id);
+     PSRDadaRingBuffer (key_t dada_id, bool use_blocks = false);
     ~PSRDadaRingBuffer ();
 
     bool connect ();
@@ -23,8 +32,15 @@ class PSRDadaRingBuffer : public DataSource {
     bool   get_error()  const { return dada_error; }
     size_t get_data(size_t nsamps, char* data);
 
+    bool   supports_views() const;
+    size_t get_view(size_t first_sample, size_t nsamps, const char*& data);
+
   private:
 
+    // Opens the next block of the data ring, returning false at its end
+    bool open_block ();
+    void close_block ();
+
     key_t  dada_key;
 
     dada_hdu_t* hdu;
@@ -33,5 +49,19 @@ class PSRDadaRingBuffer : public DataSource {
 
     bool printed_first_line;
 
+    bool     use_blocks;
+    char *   block;          // The open block of the data ring
+    uint64_t block_bytes;
+    size_t   block_start;    // Sample of the stream at which block starts
+    size_t   block_nsamps;
+    bool     end_of_data;
+
+    // Samples of released blocks that may still be viewed, from stage_start
+    //   up to block_start, followed while assembling a view by the head of
+    //   the open block
+    std::vector<char> stage;
+    size_t            stage_start;
+    size_t            stage_nsamps;
+
 };
 
@@ -0,0 +1,75 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#ifndef __ReplaySource_h
+#define __ReplaySource_h
+
+#include <fstream>
+#include <memory>
+#include <chrono>
+
+#include "hd/DataSource.h"
+
+// Wraps another source to deliver its data no faster than speed times real
+//   time, as a telescope would, or as fast as it can for speed 0
+// Each gulp is compared with the time its last sample would have arrived in
+//   real time (at speed, or 1 if unpaced), to measure how far the pipeline
+//   falls behind, or how much headroom it has
+// With a record filename, everything delivered is also written to a SIGPROC
+//   file, e.g. to capture a live stream for replay later
+class ReplaySource : public DataSource
+{
+  public:
+
+    // Takes ownership of source
+    ReplaySource (DataSource* source, double speed, const char* record_filename = 0);
+
+    bool   get_error() const;
+    size_t get_data (size_t nsamps, char* data);
+
+    bool   supports_views() const { return m_source->supports_views(); }
+    size_t get_view (size_t first_sample, size_t nsamps, const char*& data);
+    size_t get_max_view () const { return m_source->get_max_view(); }
+
+    DataSource * get_source () { return m_source.get(); }
+
+    // Seconds between the last gulp arriving in real time and being
+    //   delivered to the pipeline, negative if it was asked for early
+    double get_lag () const { return m_lag; }
+    double get_max_lag () const { return m_max_lag; }
+    double get_mean_lag () const { return m_ngulps ? m_sum_lag / m_ngulps : 0; }
+    size_t get_ngulps () const { return m_ngulps; }
+    // Gulps delivered after they arrived
+    size_t get_nlate () const { return m_nlate; }
+
+  private:
+
+    // Waits until the samples before end have arrived, and measures the lag
+    void   pace (size_t end);
+    // Writes the samples from first_sample on that have not been already
+    void   record (const char* data, size_t first_sample, size_t nsamps);
+
+    typedef std::chrono::steady_clock Clock;
+
+    std::unique_ptr<DataSource> m_source;
+    double          m_speed;
+    bool            m_error;
+    bool            m_started;
+    Clock::time_point m_start;
+    size_t          m_delivered;  // Samples delivered through get_data
+
+    std::ofstream   m_record;
+    size_t          m_recorded;
+
+    double          m_lag;
+    double          m_max_lag;
+    double          m_sum_lag;
+    size_t          m_ngulps;
+    size_t          m_nlate;
+};
+
+#endif
@@ -0,0 +1,118 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#ifndef __ShmRing_h
+#define __ShmRing_h
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+// A POSIX shared memory ring of bytes with one producer and up to
+//   ShmRingHeader::max_readers readers, coordinated only through the atomic
+//   counters in its header
+// The data are mapped twice, back to back, so that any span of up to the
+//   capacity of the ring is contiguous in memory however it wraps around
+// A producer with readers attached waits for the slowest of them; without
+//   any it runs freely. Readers attach at the data being written at the time,
+//   and are dropped should their process exit without detaching
+
+// Lives at the start of the shared memory, and describes the observation as
+//   the PSRDADA header does
+struct ShmRingHeader
+{
+  static const uint32_t magic_value = 0x48445348;  // "HDSH"
+  static const uint32_t version_value = 1;
+  static const unsigned max_readers = 16;
+
+  uint32_t magic;
+  uint32_t version;
+  uint64_t header_size;   // Offset of the data, a multiple of the page size
+  uint64_t capacity;      // Bytes of data, a multiple of the page size
+
+  // Observation, valid once ready is set
+  uint32_t nchan;
+  uint32_t nbit;
+  uint32_t npol;
+  uint32_t beam;
+  double   tsamp;         // Seconds
+  double   f0;            // Centre frequency of the first channel in MHz
+  double   df;            // Channel width in MHz
+  int64_t  utc_start;
+
+  std::atomic<uint32_t> ready;
+  std::atomic<uint32_t> eod;   // No more data will be written
+  std::atomic<uint64_t> head;  // Bytes written since the start
+
+  struct Reader
+  {
+    std::atomic<uint32_t> active;
+    std::atomic<int32_t>  pid;   // Lets a reader that died be dropped
+    std::atomic<uint64_t> tail;  // Bytes the reader is done with
+  };
+  Reader readers[max_readers];
+};
+
+class ShmRing
+{
+  public:
+
+    ShmRing ();
+    ~ShmRing ();
+
+    // Producer
+
+    // Creates the ring, replacing any left behind under name; the
+    //   observation is then filled in through get_header() and published
+    //   with start()
+    bool   create (const char* name, size_t capacity);
+    void   start ();
+    // Waits until at least unit of the nbytes can be written, returning
+    //   where, and reduces nbytes to the whole units that can
+    // Note: Taking less than asked for lets the ring always be filled,
+    //         whatever its capacity
+    char * reserve (size_t& nbytes, size_t unit = 1);
+    // Makes the nbytes written after reserve() visible to readers
+    void   commit (size_t nbytes);
+    // Marks the end of the data
+    void   end ();
+    unsigned get_nreaders () const;
+
+    // Reader
+
+    // Attaches to the ring once it has been created and started, waiting
+    //   for it unless wait is false
+    bool   attach (const char* name, bool wait = true);
+    // Stream offset at which the reader attached
+    uint64_t get_start () const { return m_start; }
+    // Waits until the data up to offset have been written, or they end,
+    //   returning the offset written up to, which may be beyond offset
+    uint64_t wait_for (uint64_t offset) const;
+    // Lets the producer overwrite the data before offset
+    void   release (uint64_t offset);
+    const char * at (uint64_t offset) const;
+
+    ShmRingHeader * get_header () { return m_header; }
+    const ShmRingHeader * get_header () const { return m_header; }
+    size_t get_capacity () const { return m_header ? m_header->capacity : 0; }
+
+  private:
+
+    bool   map (int fd, size_t header_size, size_t capacity, bool writable);
+    void   unmap ();
+    void   drop_dead_readers ();
+
+    std::string     m_name;
+    bool            m_owner;    // Created the ring, so unlinks it
+    ShmRingHeader * m_header;
+    char *          m_data;     // Followed by a second mapping of the data
+    size_t          m_map_size;
+    int             m_reader;   // Index in m_header->readers
+    uint64_t        m_start;
+};
+
+#endif
@@ -0,0 +1,41 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#ifndef __ShmRingBuffer_h
+#define __ShmRingBuffer_h
+
+#include <time.h>
+
+#include "hd/ShmRing.h"
+#include "hd/DataSource.h"
+
+// Reads the stream a local producer (e.g. fil2shm) writes into a ShmRing,
+//   starting with the data being written when it attaches
+// Views point straight into the ring, so are limited to the samples it can
+//   hold; get_data reads any number through several of them
+class ShmRingBuffer : public DataSource
+{
+  public:
+
+    // Waits for the producer to create the ring
+    ShmRingBuffer (const char* name);
+
+    bool   get_error() const { return m_error; }
+    size_t get_data (size_t nsamps, char* data);
+
+    bool   supports_views() const { return ! m_error; }
+    size_t get_view (size_t first_sample, size_t nsamps, const char*& data);
+    size_t get_max_view () const;
+
+  private:
+
+    ShmRing  m_ring;
+    bool     m_error;
+    size_t   m_cursor;      // Next sample for get_data
+};
+
+#endif
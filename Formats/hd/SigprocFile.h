@@ -5,42 +5,80 @@
  *
  ***************************************************************************/
 
+#ifndef __SigprocFile_h
+#define __SigprocFile_h
 
 #include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
 
 #include "hd/DataSource.h"
 
+// Note: 32-bit (float) files are delivered as 16-bit unsigned samples, as
+//         dedisp only takes integer input; each channel is scaled to put its
+//         mean at the middle of the range and quantisation_sigma standard
+//         deviations at either end, as measured in the first gulp
 class SigprocFile: public DataSource 
 {
   public:
 
-    SigprocFile (const char* filename, bool fswap);
+    // With use_mmap the file is mapped rather than read, falling back to
+    //   reading if it cannot be
+    SigprocFile (const char* filename, bool fswap, bool use_mmap=false);
     ~SigprocFile ();
 
     bool   get_error() const { return m_error != 0; }
     size_t get_data (size_t nsamps, char* data);
 
+    // Views are only offered if the data need no swapping or conversion
+    bool   supports_views() const;
+    size_t get_view (size_t first_sample, size_t nsamps, const char*& data);
+
+    // Asks the kernel to start reading the first nsamps into the page cache
+    virtual void prefetch (size_t nsamps);
+
+    // Quantises 32-bit data as other does, rather than from its own first
+    //   gulp, e.g. for the next file of an observation
+    void copy_scaling (const SigprocFile& other);
+
+  protected:
+
+    // Reads the next nsamps as they are stored in the file, returning the
+    //   no. samples read
+    virtual size_t read_samples (size_t nsamps, char* data);
+
+    int           m_error;
+    size_t        m_data_offset;  // Size of the header
+    size_t        m_file_stride;  // Bytes per sample in the file
+
   private:
 
-    inline unsigned char flip_4bit (unsigned char val)
-    {
-        return (((val & 0x3) << 6) |
-                ((val & 0xC) << 2) |
-                ((val & 0x30) >> 2) |
-                ((val & 0xC0) >> 6));
-    };
+    bool   map_file (const char* filename);
 
-    inline unsigned char flip_2bit (unsigned char val)
-    {
-        return (((val & 0x0F) << 4) |
-                ((val & 0xF0) >> 4));
-    };
+    std::string   m_filename;
+    // Advises the kernel that everything before first_sample is done with,
+    //   and that the nsamps after it are wanted next
+    void   advise (size_t first_sample, size_t nsamps);
 
     std::ifstream m_file_stream;
-    int           m_error;
-    bool          first_time;
-    float         offset;
-    float         scale;
-    bool          fswap;
+    char *        m_map;          // Whole file, when mapped
+    size_t        m_map_size;
+    size_t        m_nsamps;       // Total in the file, when mapped
+    size_t        m_cursor;       // Next sample for get_data, when mapped
+    size_t        m_released;     // Bytes of the mapping released so far
+    // Sets the per channel scaling of 32-bit data from nsamps of it
+    void   set_scaling (const float* in, size_t nsamps);
+    // Returns the no. values that had to be clipped
+    size_t quantise (const float* in, size_t nsamps, uint16_t* out) const;
+
+    bool               first_time;
+    bool               m_warned_clipping;
+    std::vector<float> m_offset;   // Per channel, for 32-bit data
+    std::vector<float> m_scale;
+    std::vector<char>  m_raw;      // 32-bit data before quantisation
+    bool               fswap;
 
 };
+
+#endif
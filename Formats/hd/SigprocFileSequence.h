@@ -0,0 +1,67 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#ifndef __SigprocFileSequence_h
+#define __SigprocFileSequence_h
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <future>
+
+#include "hd/SigprocFile.h"
+
+// An observation split over consecutive SIGPROC files, read as one stream
+//   of samples that starts with the first file
+// The headers of all files are checked up front: each must match the first
+//   in its channels, bits and sampling, and start where the one before ends
+// While a file is read, the next is opened and prefetched in the background
+class SigprocFileSequence: public DataSource
+{
+  public:
+
+    // Files are read as SigprocFile (use_mmap) or, with read_ahead > 0, as
+    //   AsyncSigprocFile with read_ahead reads in flight
+    SigprocFileSequence (const std::vector<std::string>& filenames, bool fswap,
+                         bool use_mmap, unsigned read_ahead);
+    ~SigprocFileSequence ();
+
+    bool   get_error() const { return m_error != 0; }
+    size_t get_data (size_t nsamps, char* data);
+
+    bool   supports_views() const;
+    size_t get_view (size_t first_sample, size_t nsamps, const char*& data);
+
+  private:
+
+    bool check_headers ();
+    SigprocFile * open_file (size_t ifile);
+    // Starts opening the file after the current one
+    void open_next ();
+    // Waits for the file after the current one to be opened
+    SigprocFile * next_file ();
+    // Moves on to the next file, returning false after the last
+    bool advance ();
+
+    std::vector<std::string>  m_filenames;
+    std::vector<size_t>       m_nsamps;      // In each file
+    bool                      m_fswap;
+    bool                      m_use_mmap;
+    unsigned                  m_read_ahead;
+    int                       m_error;
+
+    size_t                        m_ifile;       // Index of m_file
+    size_t                        m_file_start;  // Sample of the stream at which m_file starts
+    std::unique_ptr<SigprocFile>  m_file;
+    std::future<SigprocFile *>    m_opening;     // The next file, in the background
+    std::unique_ptr<SigprocFile>  m_next;        // The next file, once opened
+
+    // Views that straddle files are copied together here
+    std::vector<char>         m_stitched;
+};
+
+#endif
@@ -0,0 +1,164 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+/*
+  Packing and unpacking of nbits samples stored little-endian within
+    words (channel k of a word occupies bits [k*nbits, (k+1)*nbits)).
+
+  Everything here is specialised at compile time on NBITS so that the
+    shifts and masks become constants and the inner loops can be unrolled
+    and vectorised. Callers should select the specialisation once per gulp
+    with dispatch() rather than branching on nbits per sample.
+
+  The word-level functions are plain inline code and are safe to call from
+    SYCL kernels as well as host code.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <type_traits>
+
+namespace heimdall {
+namespace bitpack {
+
+template<int NBITS, typename WordType=unsigned int>
+struct traits {
+	static_assert(NBITS == 1 || NBITS == 2 || NBITS == 4 || NBITS == 8 ||
+	              NBITS == 16 || NBITS == 32,
+	              "Unsupported number of bits per sample");
+	static_assert(std::is_unsigned<WordType>::value &&
+	              sizeof(WordType)*8 >= (std::size_t)NBITS,
+	              "WordType must be unsigned and hold at least one sample");
+
+	enum { word_bits      = sizeof(WordType)*8,
+	       samps_per_word = word_bits / NBITS };
+	// Note: Computed without shifting by the word width, which is UB
+	static constexpr WordType mask =
+		NBITS == word_bits ? WordType(~WordType(0)) :
+		                     WordType((WordType(1) << (NBITS % word_bits)) - 1);
+};
+
+// Returns sample k (0 <= k < samps_per_word) from a packed word
+template<int NBITS, typename WordType>
+inline WordType extract(WordType word, unsigned int k) {
+	return (word >> (k*NBITS)) & traits<NBITS,WordType>::mask;
+}
+
+// Returns word with sample k replaced by val
+template<int NBITS, typename WordType>
+inline WordType insert(WordType word, unsigned int k, WordType val) {
+	const WordType mask = traits<NBITS,WordType>::mask;
+	word &= ~WordType(mask << (k*NBITS));
+	return word | WordType((val & mask) << (k*NBITS));
+}
+
+// Returns sample c from a packed spectrum
+template<int NBITS, typename WordType>
+inline WordType sample(const WordType* in, unsigned int c) {
+	enum { n = traits<NBITS,WordType>::samps_per_word };
+	return extract<NBITS>(in[c / n], c % n);
+}
+
+// Unpacks count samples to float (count must be a multiple of samps_per_word)
+template<int NBITS, typename WordType>
+inline void unpack(const WordType* in, std::size_t count, float* out) {
+	enum { n = traits<NBITS,WordType>::samps_per_word };
+	for( std::size_t w=0; w<count/n; ++w ) {
+		WordType word = in[w];
+		for( unsigned int k=0; k<n; ++k ) {
+			out[w*n + k] = (float)extract<NBITS>(word, k);
+		}
+	}
+}
+
+// Packs count floats, truncating each to an NBITS unsigned integer
+// Note: Values are not clipped; callers must ensure they are in range
+template<int NBITS, typename WordType>
+inline void repack(const float* in, std::size_t count, WordType* out) {
+	enum { n = traits<NBITS,WordType>::samps_per_word };
+	const WordType mask = traits<NBITS,WordType>::mask;
+	for( std::size_t w=0; w<count/n; ++w ) {
+		WordType word = 0;
+		for( unsigned int k=0; k<n; ++k ) {
+			word |= WordType(WordType(in[w*n + k]) & mask) << (k*NBITS);
+		}
+		out[w] = word;
+	}
+}
+
+// Returns byte with the order of its NBITS samples reversed
+template<int NBITS>
+inline unsigned char reverse_byte(unsigned char b) {
+	if( NBITS == 1 ) {
+		b = ((b & 0xF0) >> 4) | ((b & 0x0F) << 4);
+		b = ((b & 0xCC) >> 2) | ((b & 0x33) << 2);
+		b = ((b & 0xAA) >> 1) | ((b & 0x55) << 1);
+	}
+	else if( NBITS == 2 ) {
+		b = ((b & 0xF0) >> 4) | ((b & 0x0F) << 4);
+		b = ((b & 0xCC) >> 2) | ((b & 0x33) << 2);
+	}
+	else if( NBITS == 4 ) {
+		b = ((b & 0xF0) >> 4) | ((b & 0x0F) << 4);
+	}
+	return b;
+}
+
+// Reverses the channel order of nsamps packed spectra of nchans each, in place
+template<int NBITS>
+inline void reverse_channels(unsigned char* data,
+                             std::size_t nsamps, std::size_t nchans) {
+	if( NBITS >= 8 ) {
+		// Whole-sample granularity: swap bytes in units of NBITS/8
+		enum { nbytes = NBITS >= 8 ? NBITS/8 : 1 };
+		for( std::size_t t=0; t<nsamps; ++t ) {
+			unsigned char* row = data + t*nchans*nbytes;
+			for( std::size_t i=0, j=nchans-1; i<nchans/2; ++i, --j ) {
+				unsigned char tmp[nbytes];
+				std::memcpy(tmp,            row + i*nbytes, nbytes);
+				std::memcpy(row + i*nbytes, row + j*nbytes, nbytes);
+				std::memcpy(row + j*nbytes, tmp,            nbytes);
+			}
+		}
+	}
+	else {
+		// Sub-byte granularity: reverse byte order, then samples within bytes
+		std::size_t row_bytes = nchans*NBITS/8;
+		for( std::size_t t=0; t<nsamps; ++t ) {
+			unsigned char* row = data + t*row_bytes;
+			for( std::size_t i=0, j=row_bytes-1; i<row_bytes/2; ++i, --j ) {
+				unsigned char a = reverse_byte<NBITS>(row[i]);
+				row[i] = reverse_byte<NBITS>(row[j]);
+				row[j] = a;
+			}
+			if( row_bytes % 2 ) {
+				row[row_bytes/2] = reverse_byte<NBITS>(row[row_bytes/2]);
+			}
+		}
+	}
+}
+
+// Calls f(std::integral_constant<int,NBITS>()) for the given runtime nbits
+// Returns false (without calling f) if nbits is not supported
+template<typename Func>
+inline bool dispatch(std::size_t nbits, Func&& f) {
+	switch( nbits ) {
+	case 1:  f(std::integral_constant<int,1>());  return true;
+	case 2:  f(std::integral_constant<int,2>());  return true;
+	case 4:  f(std::integral_constant<int,4>());  return true;
+	case 8:  f(std::integral_constant<int,8>());  return true;
+	case 16: f(std::integral_constant<int,16>()); return true;
+	case 32: f(std::integral_constant<int,32>()); return true;
+	default: return false;
+	}
+}
+
+} // namespace bitpack
+} // namespace heimdall
@@ -0,0 +1,155 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+/*
+  Length-prefixed binary frames for streaming candidates to the coincidencer.
+
+  Each gulp of a beam is sent as one frame:
+    CandidateFrameHeader  (type CANDFRAME_GULP, length of what follows)
+    CandidateGulpHeader
+    count x CandidateRecord
+
+  A sender that sets CANDFRAME_FLAG_ACK on a gulp is answered on the same
+  connection with a CANDFRAME_ACK frame once the chunk holding the gulp has
+  been written out, or a CANDFRAME_LATE frame if the chunk had already been
+  written when the gulp arrived. Either carries one CandidateAck.
+
+  All values are in host (little-endian) byte order.
+ */
+
+#ifndef hd_CandidateFrame
+#define hd_CandidateFrame
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#define CANDFRAME_MAGIC   0x46434448 // "HDCF"
+#define CANDFRAME_VERSION 1
+
+// Frames larger than this are taken to mean a corrupt stream
+#define CANDFRAME_MAX_LENGTH (64 << 20)
+
+enum {
+  CANDFRAME_GULP = 1,
+  CANDFRAME_ACK  = 2,
+  CANDFRAME_LATE = 3
+};
+
+// Header flags
+#define CANDFRAME_FLAG_ACK 0x1
+
+struct CandidateFrameHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t type;
+  uint32_t length;   // Bytes following this header
+  uint32_t flags;
+};
+
+struct CandidateGulpHeader
+{
+  int64_t  utc_start;        // UTC time of the first sample of the observation
+  int64_t  first_sample_utc; // UTC time of first_sample
+  uint64_t first_sample;     // First sample of the gulp
+  uint32_t beam;             // 1-based beam number
+  uint32_t count;            // No. CandidateRecords following
+};
+
+struct CandidateRecord
+{
+  float    snr;
+  float    time;     // Seconds since utc_start
+  float    dm;
+  uint32_t filter;
+  uint32_t dm_trial;
+  uint32_t members;
+  uint64_t samp;
+  uint64_t begin;
+  uint64_t end;
+};
+
+struct CandidateAck
+{
+  uint64_t first_sample; // Of the acknowledged gulp
+  uint32_t beam;         // 1-based beam number of the acknowledged gulp
+  uint32_t nbeams;       // No. beams in the chunk when written, 0 if late
+};
+
+// Replaces buffer with the frame for a gulp of candidates
+inline void encode_candidate_frame (std::vector<char>& buffer,
+                                    const CandidateGulpHeader& gulp,
+                                    const CandidateRecord* records,
+                                    uint32_t flags=0)
+{
+  CandidateFrameHeader header;
+  header.magic    = CANDFRAME_MAGIC;
+  header.version  = CANDFRAME_VERSION;
+  header.type     = CANDFRAME_GULP;
+  header.length   = sizeof(gulp) + gulp.count * sizeof(CandidateRecord);
+  header.flags    = flags;
+
+  buffer.resize (sizeof(header) + header.length);
+  char* ptr = &buffer[0];
+  memcpy (ptr, &header, sizeof(header));
+  ptr += sizeof(header);
+  memcpy (ptr, &gulp, sizeof(gulp));
+  ptr += sizeof(gulp);
+  if (gulp.count)
+    memcpy (ptr, records, gulp.count * sizeof(CandidateRecord));
+}
+
+inline bool is_valid_frame_header (const CandidateFrameHeader& header)
+{
+  return header.magic   == CANDFRAME_MAGIC &&
+         header.version == CANDFRAME_VERSION &&
+         header.length  <= CANDFRAME_MAX_LENGTH;
+}
+
+// Points gulp and records into a received frame payload, returning false
+//   if its length does not match the record count
+inline bool decode_gulp_frame (const char* payload, size_t length,
+                               CandidateGulpHeader& gulp,
+                               const CandidateRecord*& records)
+{
+  if (length < sizeof(gulp))
+    return false;
+  memcpy (&gulp, payload, sizeof(gulp));
+  if (length != sizeof(gulp) + (size_t) gulp.count * sizeof(CandidateRecord))
+    return false;
+  records = (const CandidateRecord*) (payload + sizeof(gulp));
+  return true;
+}
+
+// Replaces buffer with a CANDFRAME_ACK or CANDFRAME_LATE frame
+inline void encode_ack_frame (std::vector<char>& buffer, uint16_t type,
+                              const CandidateAck& ack)
+{
+  CandidateFrameHeader header;
+  header.magic    = CANDFRAME_MAGIC;
+  header.version  = CANDFRAME_VERSION;
+  header.type     = type;
+  header.length   = sizeof(ack);
+  header.flags    = 0;
+
+  buffer.resize (sizeof(header) + sizeof(ack));
+  memcpy (&buffer[0], &header, sizeof(header));
+  memcpy (&buffer[sizeof(header)], &ack, sizeof(ack));
+}
+
+inline bool decode_ack_frame (const char* payload, size_t length,
+                              CandidateAck& ack)
+{
+  if (length != sizeof(ack))
+    return false;
+  memcpy (&ack, payload, sizeof(ack));
+  return true;
+}
+
+#endif
@@ -0,0 +1,38 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#ifndef hd_CandidateFrameReader
+#define hd_CandidateFrameReader
+
+#include <vector>
+
+#include "hd/CandidateFrame.h"
+
+// Reassembles frames from whatever pieces a non-blocking socket returns
+class CandidateFrameReader
+{
+  public:
+
+    CandidateFrameReader () : m_start ( 0 ), m_corrupt ( false ) {}
+
+    void append ( const char * data, size_t size );
+
+    // Takes the next complete frame, if there is one
+    // Note: payload points into the reader and is valid until the next call
+    bool next ( CandidateFrameHeader& header, const char *& payload );
+
+    // True once a frame header failed validation; nothing more can be read
+    bool is_corrupt () const { return m_corrupt; }
+
+  private:
+
+    std::vector<char> m_buffer;
+    size_t            m_start;    // Start of the unconsumed data in m_buffer
+    bool              m_corrupt;
+};
+
+#endif
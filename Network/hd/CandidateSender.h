@@ -0,0 +1,47 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#ifndef hd_CandidateSender
+#define hd_CandidateSender
+
+#include <time.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "hd/ClientSocket.h"
+#include "hd/CandidateFrame.h"
+
+// Persistent connection to the coincidencer, sending each gulp as a single
+//   frame. The connection is (re)made on demand; after a failed attempt,
+//   no further attempts are made for retry_seconds, so that an absent
+//   coincidencer does not stall every gulp.
+class CandidateSender
+{
+  public:
+
+    CandidateSender ( std::string host, int port, int retry_seconds=5 );
+
+    // Returns false if the gulp could not be delivered
+    bool send ( const CandidateGulpHeader& gulp, const CandidateRecord* records );
+
+    bool is_connected() const { return m_socket.get() != 0; }
+
+  private:
+
+    bool connect ();
+
+    std::string                   m_host;
+    int                           m_port;
+    int                           m_retry_seconds;
+    time_t                        m_last_attempt;
+    std::unique_ptr<ClientSocket> m_socket;
+    std::vector<char>             m_buffer;
+};
+
+#endif
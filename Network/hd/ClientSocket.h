@@ -23,6 +23,12 @@ class ClientSocket : private Socket
     const ClientSocket& operator << ( const float f ) const;
     const ClientSocket& operator >> ( std::string& ) const;
 
+    // Sends all of buf in one go
+    void write ( const void * buf, size_t size ) const;
+
+    using Socket::get_fd;
+    using Socket::recv_some;
+
 };
 
 #endif
@@ -22,8 +22,16 @@ class ServerSocket : private Socket
     const ServerSocket& operator >> ( std::string& ) const;
     const ServerSocket& operator >> ( std::stringstream& ) const;
 
+    // Receives exactly size bytes
+    void read ( void * buf, size_t size ) const;
+
     void accept ( ServerSocket& );
     int select (float sleep_seconds );
+
+    using Socket::get_fd;
+    using Socket::recv_some;
+    using Socket::send_some;
+    using Socket::set_non_blocking;
 };
 
 #endif
@@ -39,9 +39,21 @@ class Socket
     bool send ( const std::string ) const;
     int recv ( std::string& ) const;
 
+    // Sends or receives exactly size bytes, returning false on failure or
+    //   (for recv_all) if the peer closes the connection first
+    bool send_all ( const void * buf, size_t size ) const;
+    bool recv_all ( void * buf, size_t size ) const;
+    // Sends or receives whatever can be without blocking, up to size bytes,
+    //   as ::send and ::recv do
+    ssize_t send_some ( const void * buf, size_t size ) const;
+    ssize_t recv_some ( void * buf, size_t size ) const;
+
     void set_non_blocking ( const bool );
 
+    void set_no_delay ( const bool );
+
     bool is_valid() const { return m_sock != -1; }
+    int  get_fd() const { return m_sock; }
 
     int select_timeout ( float sleep_secs );
 
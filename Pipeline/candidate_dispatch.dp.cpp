@@ -0,0 +1,390 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#if __has_include(<sycl/sycl.hpp>)
+#include <sycl/sycl.hpp>
+#else
+#include <CL/sycl.hpp>
+#endif
+
+#include "hd/candidate_dispatch.h"
+#include "hd/label_candidate_clusters.h"
+#include "hd/merge_candidates.h"
+#include "hd/stopwatch.h"
+#include "hd/utils.hpp"
+
+#include <boost/iterator/counting_iterator.hpp>
+#include <boost/iterator/permutation_iterator.hpp>
+#include <sycl/algorithm/copy.hpp>
+#include <sycl/algorithm/copy_if.hpp>
+#include <sycl/algorithm/fill.hpp>
+#include <sycl/algorithm/for_each.hpp>
+#include <sycl/algorithm/transform.hpp>
+
+#include <vector>
+#include <random>
+#include <limits>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+const char* hd_get_exec_target_string(hd_exec_target target) {
+	switch( target ) {
+	case HD_EXEC_HOST_SERIAL:   return "host-serial";
+	case HD_EXEC_HOST_PARALLEL: return "host-parallel";
+	case HD_EXEC_DEVICE:        return "device";
+	default:                    return "unknown";
+	}
+}
+
+// Finds the earliest and latest member sample of each cluster (by root)
+struct cluster_extent_functor {
+	const hd_index* d_inds;
+	const hd_index* d_labels;
+	hd_index*       d_first;
+	hd_index*       d_last;
+	cluster_extent_functor(const hd_index* d_inds_, const hd_index* d_labels_,
+	                       hd_index* d_first_, hd_index* d_last_)
+		: d_inds(d_inds_), d_labels(d_labels_),
+		  d_first(d_first_), d_last(d_last_) {}
+	inline void operator()(unsigned int i) const {
+		typedef sycl::atomic_ref<hd_index, sycl::memory_order::relaxed,
+		                         sycl::memory_scope::device,
+		                         sycl::access::address_space::global_space> atomic_index;
+		hd_index root = d_labels[i];
+		atomic_index(d_first[root]).fetch_min(d_inds[i]);
+		atomic_index(d_last[root]).fetch_max(d_inds[i]);
+	}
+};
+
+struct is_held_functor {
+	const hd_index* d_labels;
+	const hd_index* d_first;
+	const hd_index* d_last;
+	CandidateHold   hold;
+	is_held_functor(const hd_index* d_labels_, const hd_index* d_first_,
+	                const hd_index* d_last_, CandidateHold hold_)
+		: d_labels(d_labels_), d_first(d_first_), d_last(d_last_),
+		  hold(hold_) {}
+	inline int operator()(unsigned int i) const {
+		hd_index root = d_labels[i];
+		return hold.is_held(d_first[root], d_last[root]);
+	}
+};
+
+// Splits the labelled giants into those of held clusters (moved to d_held)
+//   and the rest (d_emit, with their labels in d_emit_labels)
+static void split_held_clusters(CandidateTable&                  d_giants,
+                                const hd_index*                  d_labels,
+                                const CandidateHold&             hold,
+                                CandidateTable&                  d_held,
+                                CandidateTable&                  d_emit,
+                                device_vector_wrapper<hd_index>& d_emit_labels)
+{
+	using boost::iterators::make_counting_iterator;
+	using heimdall::util::get_raw_pointer;
+	hd_size count = d_giants.size();
+
+	device_vector_wrapper<hd_index> d_first(count);
+	device_vector_wrapper<hd_index> d_last(count);
+	sycl::impl::fill(execution_policy, d_first.begin(), d_first.end(),
+	                 std::numeric_limits<hd_index>::max());
+	sycl::impl::fill(execution_policy, d_last.begin(), d_last.end(), 0);
+	sycl::impl::for_each(execution_policy,
+	                     make_counting_iterator<unsigned int>(0),
+	                     make_counting_iterator<unsigned int>(count),
+	                     cluster_extent_functor(d_giants.raw().inds, d_labels,
+	                                            get_raw_pointer(&d_first[0]),
+	                                            get_raw_pointer(&d_last[0])));
+	device_vector_wrapper<int> d_is_held(count);
+	sycl::impl::transform(execution_policy,
+	                      make_counting_iterator<unsigned int>(0),
+	                      make_counting_iterator<unsigned int>(count),
+	                      d_is_held.begin(),
+	                      is_held_functor(d_labels,
+	                                      get_raw_pointer(&d_first[0]),
+	                                      get_raw_pointer(&d_last[0]), hold));
+
+	device_vector_wrapper<hd_index> d_held_map(count);
+	device_vector_wrapper<hd_index> d_emit_map(count);
+	hd_size held_count =
+		sycl::impl::copy_if(execution_policy,
+		                    make_counting_iterator<hd_index>(0),
+		                    make_counting_iterator<hd_index>(count),
+		                    d_is_held.begin(), // the stencil
+		                    d_held_map.begin(),
+		                    std::identity())
+		- d_held_map.begin();
+	hd_size emit_count =
+		sycl::impl::copy_if(execution_policy,
+		                    make_counting_iterator<hd_index>(0),
+		                    make_counting_iterator<hd_index>(count),
+		                    d_is_held.begin(), // the stencil
+		                    d_emit_map.begin(),
+		                    std::logical_not<int>())
+		- d_emit_map.begin();
+
+	d_giants.gather(get_raw_pointer(&d_held_map[0]), held_count, d_held);
+	d_giants.gather(get_raw_pointer(&d_emit_map[0]), emit_count, d_emit);
+	d_emit_labels.resize(emit_count);
+	if( emit_count ) {
+		sycl::impl::copy(execution_policy,
+		                 boost::make_permutation_iterator(d_labels, d_emit_map.begin()),
+		                 boost::make_permutation_iterator(d_labels, d_emit_map.begin()) + emit_count,
+		                 d_emit_labels.begin());
+	}
+}
+
+hd_error group_candidates(hd_exec_target       target,
+                          ThreadPool*          pool,
+                          hd_size              nthreads,
+                          CandidateTable&      d_giants,
+                          const hd_float*      dm_list,
+                          hd_size              time_tol,
+                          hd_size              filter_tol,
+                          hd_size              dm_tol,
+                          HostCandidateTable&  h_groups,
+                          const CandidateHold*   hold,
+                          CandidateTable*        d_held,
+                          const CandidateFilter* filter,
+                          hd_size                origin)
+{
+	hd_error error;
+	hd_size  count = d_giants.size();
+	hd_size  label_count = 0;
+	if( d_held ) {
+		d_held->clear();
+	}
+	if( count == 0 ) {
+		h_groups.clear();
+		return HD_NO_ERROR;
+	}
+
+	if( target == HD_EXEC_DEVICE ) {
+		device_vector_wrapper<hd_index> d_labels(count);
+		hd_index* d_labels_ptr = heimdall::util::get_raw_pointer(&d_labels[0]);
+		error = label_candidate_clusters(count, d_giants.raw(),
+		                                 time_tol, filter_tol, dm_tol,
+		                                 d_labels_ptr, &label_count);
+		if( error != HD_NO_ERROR ) {
+			return error;
+		}
+		CandidateTable d_groups;
+		if( hold && d_held ) {
+			CandidateTable                  d_emit;
+			device_vector_wrapper<hd_index> d_emit_labels;
+			split_held_clusters(d_giants, d_labels_ptr, *hold,
+			                    *d_held, d_emit, d_emit_labels);
+			error = merge_candidates(d_emit.size(),
+			                         d_emit.empty() ? 0 :
+			                         heimdall::util::get_raw_pointer(&d_emit_labels[0]),
+			                         d_emit, d_groups);
+		}
+		else {
+			error = merge_candidates(count, d_labels_ptr, d_giants, d_groups);
+		}
+		if( error != HD_NO_ERROR ) {
+			return error;
+		}
+		if( filter ) {
+			error = filter->apply(d_groups, origin);
+			if( error != HD_NO_ERROR ) {
+				return error;
+			}
+		}
+		return copy_to_host(d_groups, dm_list, h_groups);
+	}
+
+	HostCandidateTable h_giants;
+	error = copy_to_host(d_giants, dm_list, h_giants);
+	if( error != HD_NO_ERROR ) {
+		return error;
+	}
+	std::vector<hd_index> h_labels(count);
+	bool parallel = (target == HD_EXEC_HOST_PARALLEL);
+	error = label_candidate_clusters_host(count, h_giants.raw(),
+	                                      time_tol, filter_tol, dm_tol,
+	                                      &h_labels[0], &label_count,
+	                                      parallel ? pool : 0,
+	                                      parallel ? nthreads : 1);
+	if( error != HD_NO_ERROR ) {
+		return error;
+	}
+	if( !(hold && d_held) ) {
+		error = merge_candidates_host(count, &h_labels[0], h_giants, h_groups);
+		if( error != HD_NO_ERROR || !filter ) {
+			return error;
+		}
+		return filter->apply(h_groups, origin);
+	}
+
+	// Note: Each root is the first member of its cluster, so its extent is
+	//         complete (and its position in the emitted list known) before
+	//         any later member needs it
+	std::vector<hd_index> first(count), last(count), emit_pos(count);
+	for( hd_size i=0; i<count; ++i ) {
+		hd_index root = h_labels[i];
+		if( root == i ) {
+			first[i] = last[i] = h_giants.inds[i];
+		}
+		else {
+			first[root] = std::min(first[root], h_giants.inds[i]);
+			last[root]  = std::max(last[root],  h_giants.inds[i]);
+		}
+	}
+	std::vector<hd_index> held_map, emit_map, emit_labels;
+	for( hd_size i=0; i<count; ++i ) {
+		hd_index root = h_labels[i];
+		if( hold->is_held(first[root], last[root]) ) {
+			held_map.push_back(i);
+		}
+		else {
+			emit_pos[i] = emit_map.size();
+			emit_labels.push_back(emit_pos[root]);
+			emit_map.push_back(i);
+		}
+	}
+	HostCandidateTable h_held, h_emit;
+	h_giants.gather(held_map.data(), held_map.size(), h_held);
+	h_giants.gather(emit_map.data(), emit_map.size(), h_emit);
+	error = copy_to_device(h_held, *d_held);
+	if( error != HD_NO_ERROR ) {
+		return error;
+	}
+	error = merge_candidates_host(emit_map.size(), emit_labels.data(),
+	                              h_emit, h_groups);
+	if( error != HD_NO_ERROR || !filter ) {
+		return error;
+	}
+	return filter->apply(h_groups, origin);
+}
+
+// Returns the smallest size from which t_b beats t_a at every larger size
+//   too, or the largest hd_size if t_b does not win at the largest size
+static hd_size find_crossover(const std::vector<hd_size>& sizes,
+                              const std::vector<float>&   t_a,
+                              const std::vector<float>&   t_b) {
+	hd_size crossover = std::numeric_limits<hd_size>::max();
+	for( hd_size s=sizes.size(); s-- > 0; ) {
+		if( !(t_b[s] < t_a[s]) ) {
+			break;
+		}
+		crossover = (s == 0) ? 0 : sizes[s];
+	}
+	return crossover;
+}
+
+hd_error calibrate_candidate_dispatch(const hd_params&   params,
+                                      const hd_float*    dm_list,
+                                      hd_size            dm_count,
+                                      ThreadPool*        pool,
+                                      CandidateDispatch* dispatch)
+{
+	enum { REPEATS = 3 };
+	std::vector<hd_size> sizes;
+	for( hd_size n=16; n<=65536; n*=4 ) {
+		sizes.push_back(n);
+	}
+	hd_size filter_count = 0;
+	while( ((hd_size)1 << filter_count) <= params.boxcar_max ) {
+		++filter_count;
+	}
+
+	// Synthetic giants spread uniformly over a gulp
+	// Note: A fixed seed keeps the calibration repeatable
+	std::mt19937 rng(12345);
+	std::uniform_int_distribution<hd_index> samp_dist(0, params.nsamps_gulp-1);
+	std::uniform_int_distribution<hd_index> filter_dist(0, filter_count-1);
+	std::uniform_int_distribution<hd_index> dm_dist(0, dm_count-1);
+	std::uniform_real_distribution<hd_float> peak_dist(params.detect_thresh,
+	                                                   4*params.detect_thresh);
+	HostCandidateTable h_all;
+	h_all.resize(sizes.back());
+	for( hd_size i=0; i<h_all.size(); ++i ) {
+		h_all.peaks[i]       = peak_dist(rng);
+		h_all.inds[i]        = samp_dist(rng);
+		h_all.begins[i]      = h_all.inds[i];
+		h_all.ends[i]        = h_all.inds[i];
+		h_all.filter_inds[i] = filter_dist(rng);
+		h_all.dm_inds[i]     = dm_dist(rng);
+		h_all.members[i]     = 1;
+	}
+
+	hd_exec_target targets[] = { HD_EXEC_HOST_SERIAL,
+	                             HD_EXEC_HOST_PARALLEL,
+	                             HD_EXEC_DEVICE };
+	std::vector<float> times[3];
+	HostCandidateTable h_giants;
+	HostCandidateTable h_groups;
+	CandidateTable     d_giants;
+	hd_error           error;
+
+	// Warm up the device (e.g., JIT compilation of the kernels) untimed
+	h_giants = h_all;
+	h_giants.resize(sizes[0]);
+	error = copy_to_device(h_giants, d_giants);
+	if( error == HD_NO_ERROR ) {
+		error = group_candidates(HD_EXEC_DEVICE, pool, params.ncpus, d_giants,
+		                         dm_list, params.cand_sep_time,
+		                         params.cand_sep_filter, params.cand_sep_dm,
+		                         h_groups);
+	}
+	if( error != HD_NO_ERROR ) {
+		return error;
+	}
+
+	for( hd_size s=0; s<sizes.size(); ++s ) {
+		h_giants = h_all;
+		h_giants.resize(sizes[s]);
+		for( int t=0; t<3; ++t ) {
+			float best = std::numeric_limits<float>::max();
+			if( targets[t] == HD_EXEC_HOST_PARALLEL && !pool ) {
+				times[t].push_back(best);
+				continue;
+			}
+			for( int r=0; r<REPEATS; ++r ) {
+				// Note: Re-uploaded each time as the device merge modifies it
+				error = copy_to_device(h_giants, d_giants);
+				if( error != HD_NO_ERROR ) {
+					return error;
+				}
+				Stopwatch timer;
+				timer.start();
+				error = group_candidates(targets[t], pool, params.ncpus,
+				                         d_giants, dm_list,
+				                         params.cand_sep_time,
+				                         params.cand_sep_filter,
+				                         params.cand_sep_dm,
+				                         h_groups);
+				timer.stop();
+				if( error != HD_NO_ERROR ) {
+					return error;
+				}
+				best = std::min(best, timer.getTime());
+			}
+			times[t].push_back(best);
+		}
+		if( params.verbosity >= 2 ) {
+			cout << "\t" << sizes[s] << " giants: "
+			     << times[0][s] << " / " << times[1][s] << " / "
+			     << times[2][s] << " s (serial / parallel / device)" << endl;
+		}
+	}
+
+	dispatch->parallel_min = find_crossover(sizes, times[0], times[1]);
+	// Compare the device against whichever host target would be selected
+	std::vector<float> host_times(sizes.size());
+	for( hd_size s=0; s<sizes.size(); ++s ) {
+		host_times[s] = sizes[s] >= dispatch->parallel_min ? times[1][s]
+		                                                   : times[0][s];
+	}
+	dispatch->device_min = find_crossover(sizes, host_times, times[2]);
+
+	return HD_NO_ERROR;
+}
@@ -0,0 +1,338 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#if __has_include(<sycl/sycl.hpp>)
+#include <sycl/sycl.hpp>
+#else
+#include <CL/sycl.hpp>
+#endif
+
+#include "hd/candidate_filter.h"
+#include "hd/utils.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <boost/iterator/counting_iterator.hpp>
+#include <sycl/algorithm/transform.hpp>
+#include <sycl/algorithm/copy_if.hpp>
+
+namespace {
+
+struct filter_variable {
+	const char* name;
+	int         index;
+};
+const filter_variable filter_variables[] = {
+	{ "snr",      HD_FILTER_VAR_SNR      },
+	{ "dm",       HD_FILTER_VAR_DM       },
+	{ "dm_trial", HD_FILTER_VAR_DM_TRIAL },
+	{ "members",  HD_FILTER_VAR_MEMBERS  },
+	{ "filter",   HD_FILTER_VAR_FILTER   },
+	{ "width",    HD_FILTER_VAR_WIDTH    },
+	{ "samp",     HD_FILTER_VAR_SAMP     },
+	{ "time",     HD_FILTER_VAR_TIME     },
+	{ "begin",    HD_FILTER_VAR_BEGIN    },
+	{ "end",      HD_FILTER_VAR_END      }
+};
+
+// Recursive-descent compiler from infix to postfix
+class filter_compiler {
+public:
+	filter_compiler(const char* expr, CandidateFilterProgram& program)
+		: m_pos(expr), m_program(program), m_depth(0), m_max_depth(0) {
+		m_program.op_count = 0;
+	}
+
+	bool compile() {
+		skip_space();
+		if( !*m_pos ) {
+			return true; // Empty expression accepts everything
+		}
+		if( !parse_or() ) {
+			return false;
+		}
+		skip_space();
+		if( *m_pos ) {
+			return fail("unexpected '" + std::string(m_pos) + "'");
+		}
+		if( m_max_depth > CandidateFilterProgram::MAX_STACK ) {
+			return fail("expression is nested too deeply");
+		}
+		return true;
+	}
+	const std::string& message() const { return m_message; }
+
+private:
+	const char*             m_pos;
+	CandidateFilterProgram& m_program;
+	int                     m_depth;
+	int                     m_max_depth;
+	std::string             m_message;
+
+	bool fail(const std::string& message) {
+		if( m_message.empty() ) {
+			m_message = message;
+		}
+		return false;
+	}
+	void skip_space() {
+		while( std::isspace((unsigned char)*m_pos) ) {
+			++m_pos;
+		}
+	}
+	bool accept(const char* token) {
+		skip_space();
+		std::size_t len = std::strlen(token);
+		if( std::strncmp(m_pos, token, len) != 0 ) {
+			return false;
+		}
+		// Don't match a prefix of a longer operator (e.g., < of <=)
+		if( len == 1 && (token[0] == '<' || token[0] == '>' ||
+		                 token[0] == '!') && m_pos[1] == '=' ) {
+			return false;
+		}
+		m_pos += len;
+		return true;
+	}
+	// Appends an op, tracking the stack depth it leaves
+	bool emit(int op, hd_float arg=0) {
+		if( m_program.op_count == CandidateFilterProgram::MAX_OPS ) {
+			return fail("expression is too long");
+		}
+		m_program.ops[m_program.op_count]  = op;
+		m_program.args[m_program.op_count] = arg;
+		++m_program.op_count;
+		if( op == HD_FILTER_OP_CONST || op == HD_FILTER_OP_VAR ) {
+			m_max_depth = std::max(m_max_depth, ++m_depth);
+		}
+		else if( op != HD_FILTER_OP_NEG && op != HD_FILTER_OP_NOT ) {
+			--m_depth;
+		}
+		return true;
+	}
+
+	bool parse_or() {
+		if( !parse_and() ) return false;
+		while( accept("||") ) {
+			if( !parse_and() || !emit(HD_FILTER_OP_OR) ) return false;
+		}
+		return true;
+	}
+	bool parse_and() {
+		if( !parse_comparison() ) return false;
+		while( accept("&&") ) {
+			if( !parse_comparison() || !emit(HD_FILTER_OP_AND) ) return false;
+		}
+		return true;
+	}
+	bool parse_comparison() {
+		if( !parse_sum() ) return false;
+		static const struct { const char* token; int op; } comparisons[] = {
+			{ "<=", HD_FILTER_OP_LE }, { ">=", HD_FILTER_OP_GE },
+			{ "==", HD_FILTER_OP_EQ }, { "!=", HD_FILTER_OP_NE },
+			{ "<",  HD_FILTER_OP_LT }, { ">",  HD_FILTER_OP_GT }
+		};
+		for( std::size_t c=0; c<sizeof(comparisons)/sizeof(comparisons[0]); ++c ) {
+			if( accept(comparisons[c].token) ) {
+				return parse_sum() && emit(comparisons[c].op);
+			}
+		}
+		return true;
+	}
+	bool parse_sum() {
+		if( !parse_product() ) return false;
+		while( true ) {
+			int op;
+			if(      accept("+") ) op = HD_FILTER_OP_ADD;
+			else if( accept("-") ) op = HD_FILTER_OP_SUB;
+			else return true;
+			if( !parse_product() || !emit(op) ) return false;
+		}
+	}
+	bool parse_product() {
+		if( !parse_unary() ) return false;
+		while( true ) {
+			int op;
+			if(      accept("*") ) op = HD_FILTER_OP_MUL;
+			else if( accept("/") ) op = HD_FILTER_OP_DIV;
+			else return true;
+			if( !parse_unary() || !emit(op) ) return false;
+		}
+	}
+	bool parse_unary() {
+		if( accept("-") ) {
+			return parse_unary() && emit(HD_FILTER_OP_NEG);
+		}
+		if( accept("!") ) {
+			return parse_unary() && emit(HD_FILTER_OP_NOT);
+		}
+		return parse_power();
+	}
+	bool parse_power() {
+		if( !parse_primary() ) return false;
+		if( accept("^") ) {
+			return parse_unary() && emit(HD_FILTER_OP_POW);
+		}
+		return true;
+	}
+	bool parse_primary() {
+		skip_space();
+		if( accept("(") ) {
+			if( !parse_or() ) return false;
+			if( !accept(")") ) return fail("missing ')'");
+			return true;
+		}
+		if( std::isdigit((unsigned char)*m_pos) || *m_pos == '.' ) {
+			char* end;
+			double value = std::strtod(m_pos, &end);
+			m_pos = end;
+			return emit(HD_FILTER_OP_CONST, (hd_float)value);
+		}
+		if( std::isalpha((unsigned char)*m_pos) || *m_pos == '_' ) {
+			const char* begin = m_pos;
+			while( std::isalnum((unsigned char)*m_pos) || *m_pos == '_' ) {
+				++m_pos;
+			}
+			std::string name(begin, m_pos);
+			for( std::size_t v=0; v<sizeof(filter_variables)/sizeof(filter_variables[0]); ++v ) {
+				if( name == filter_variables[v].name ) {
+					return emit(HD_FILTER_OP_VAR, (hd_float)filter_variables[v].index);
+				}
+			}
+			return fail("unknown variable '" + name + "'");
+		}
+		if( !*m_pos ) {
+			return fail("unexpected end of expression");
+		}
+		return fail("unexpected '" + std::string(m_pos) + "'");
+	}
+};
+
+} // namespace
+
+// Evaluates the program for group i, flagging it for keeping
+struct filter_groups_functor {
+	CandidateFilterProgram program;
+	ConstRawCandidates     groups;
+	const hd_float*        d_dm_list;
+	hd_size                origin;
+	hd_float               dt;
+	filter_groups_functor(const CandidateFilterProgram& program_,
+	                      ConstRawCandidates groups_, const hd_float* d_dm_list_,
+	                      hd_size origin_, hd_float dt_)
+		: program(program_), groups(groups_), d_dm_list(d_dm_list_),
+		  origin(origin_), dt(dt_) {}
+	inline int operator()(unsigned int i) const {
+		hd_float vars[HD_FILTER_VAR_COUNT];
+		hd_size  samp = origin + groups.inds[i];
+		vars[HD_FILTER_VAR_SNR]      = groups.peaks[i];
+		vars[HD_FILTER_VAR_DM]       = d_dm_list[groups.dm_inds[i]];
+		vars[HD_FILTER_VAR_DM_TRIAL] = groups.dm_inds[i];
+		vars[HD_FILTER_VAR_MEMBERS]  = groups.members[i];
+		vars[HD_FILTER_VAR_FILTER]   = groups.filter_inds[i];
+		vars[HD_FILTER_VAR_WIDTH]    = (hd_float)(1u << groups.filter_inds[i]);
+		vars[HD_FILTER_VAR_SAMP]     = (hd_float)samp;
+		vars[HD_FILTER_VAR_TIME]     = (hd_float)(samp * (double)dt);
+		vars[HD_FILTER_VAR_BEGIN]    = (hd_float)(origin + groups.begins[i]);
+		vars[HD_FILTER_VAR_END]      = (hd_float)(origin + groups.ends[i]);
+		return program.eval(vars);
+	}
+};
+
+hd_error CandidateFilter::compile(const char* expr, std::string* message) {
+	CandidateFilterProgram program;
+	filter_compiler compiler(expr ? expr : "", program);
+	if( !compiler.compile() ) {
+		if( message ) {
+			*message = compiler.message();
+		}
+		return HD_INVALID_CAND_FILTER;
+	}
+	m_program = program;
+	m_expr    = expr ? expr : "";
+	return HD_NO_ERROR;
+}
+
+hd_error CandidateFilter::require(const char* expr, std::string* message) {
+	if( this->empty() ) {
+		return this->compile(expr, message);
+	}
+	std::string combined = "(" + m_expr + ") && (" + expr + ")";
+	return this->compile(combined.c_str(), message);
+}
+
+void CandidateFilter::set_observation(const hd_float* dm_list,
+                                      hd_size dm_count, hd_float dt) {
+	m_h_dm_list.assign(dm_list, dm_list + dm_count);
+	m_dm_list.resize(dm_count);
+	if( dm_count ) {
+		execution_policy.get_queue()
+			.copy(dm_list, heimdall::util::get_raw_pointer(&m_dm_list[0]), dm_count)
+			.wait();
+	}
+	m_dt = dt;
+}
+
+hd_error CandidateFilter::apply(CandidateTable& d_groups,
+                                hd_size         origin) const {
+	using boost::iterators::make_counting_iterator;
+	using heimdall::util::get_raw_pointer;
+
+	hd_size count = d_groups.size();
+	if( this->empty() || count == 0 ) {
+		return HD_NO_ERROR;
+	}
+	device_vector_wrapper<int>      d_keep(count);
+	device_vector_wrapper<hd_index> d_survivors(count);
+	sycl::impl::transform(execution_policy,
+	                      make_counting_iterator<unsigned int>(0),
+	                      make_counting_iterator<unsigned int>(count),
+	                      d_keep.begin(),
+	                      filter_groups_functor(m_program, d_groups.raw(),
+	                                            get_raw_pointer(&m_dm_list[0]),
+	                                            origin, m_dt));
+	hd_size survivor_count =
+		sycl::impl::copy_if(execution_policy,
+		                    make_counting_iterator<hd_index>(0),
+		                    make_counting_iterator<hd_index>(count),
+		                    d_keep.begin(), // the stencil
+		                    d_survivors.begin(),
+		                    std::identity())
+		- d_survivors.begin();
+	if( survivor_count == count ) {
+		return HD_NO_ERROR;
+	}
+	CandidateTable d_kept;
+	d_groups.gather(get_raw_pointer(&d_survivors[0]), survivor_count, d_kept);
+	d_groups.swap(d_kept);
+	return HD_NO_ERROR;
+}
+
+hd_error CandidateFilter::apply(HostCandidateTable& h_groups,
+                                hd_size             origin) const {
+	hd_size count = h_groups.size();
+	if( this->empty() || count == 0 ) {
+		return HD_NO_ERROR;
+	}
+	filter_groups_functor keep(m_program, h_groups.raw(), &m_h_dm_list[0],
+	                           origin, m_dt);
+	std::vector<hd_index> survivors;
+	for( hd_size i=0; i<count; ++i ) {
+		if( keep(i) ) {
+			survivors.push_back(i);
+		}
+	}
+	if( survivors.size() == count ) {
+		return HD_NO_ERROR;
+	}
+	HostCandidateTable kept;
+	h_groups.gather(survivors.data(), survivors.size(), kept);
+	h_groups = kept;
+	return HD_NO_ERROR;
+}
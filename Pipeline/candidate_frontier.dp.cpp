@@ -0,0 +1,117 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#if __has_include(<sycl/sycl.hpp>)
+#include <sycl/sycl.hpp>
+#else
+#include <CL/sycl.hpp>
+#endif
+
+#include "hd/candidate_frontier.h"
+#include "hd/utils.hpp"
+
+#include <boost/iterator/counting_iterator.hpp>
+#include <sycl/algorithm/for_each.hpp>
+#include <sycl/algorithm/copy_if.hpp>
+
+// Adds delta to the sample indices of each giant
+struct advance_candidates_functor {
+	RawCandidates giants;
+	hd_index      delta;
+	advance_candidates_functor(RawCandidates giants_, hd_index delta_)
+		: giants(giants_), delta(delta_) {}
+	inline void operator()(unsigned int i) const {
+		giants.inds[i]   += delta;
+		giants.begins[i] += delta;
+		giants.ends[i]   += delta;
+	}
+};
+
+// Subtracts delta from the sample indices of each giant, flagging those
+//   that fall before zero or at or after drop_from
+// Note: Begins are clamped, as a giant's extent may reach back further
+//         than the giant itself
+struct retreat_candidates_functor {
+	RawCandidates giants;
+	hd_index      delta;
+	hd_index      drop_from;
+	int*          d_keep;
+	retreat_candidates_functor(RawCandidates giants_, hd_index delta_,
+	                           hd_index drop_from_, int* d_keep_)
+		: giants(giants_), delta(delta_), drop_from(drop_from_),
+		  d_keep(d_keep_) {}
+	inline void operator()(unsigned int i) const {
+		hd_index ind = giants.inds[i];
+		d_keep[i] = ind >= delta && ind < drop_from;
+		giants.inds[i]   = ind >= delta ? ind - delta : 0;
+		giants.begins[i] = giants.begins[i] >= delta ? giants.begins[i] - delta : 0;
+		giants.ends[i]   = giants.ends[i]   >= delta ? giants.ends[i]   - delta : 0;
+	}
+};
+
+hd_error CandidateFrontier::merge_into(hd_size first_idx,
+                                       CandidateTable& d_giants)
+{
+	using boost::iterators::make_counting_iterator;
+	using heimdall::util::get_raw_pointer;
+
+	hd_size new_origin = first_idx > m_span ? first_idx - m_span : 0;
+	if( new_origin < m_origin ) {
+		// Note: Only happens if the input restarts, in which case nothing
+		//         held can be connected to the new giants
+		m_held.clear();
+		m_origin = new_origin;
+	}
+
+	if( !d_giants.empty() && first_idx > new_origin ) {
+		sycl::impl::for_each(execution_policy,
+		                     make_counting_iterator<unsigned int>(0),
+		                     make_counting_iterator<unsigned int>(d_giants.size()),
+		                     advance_candidates_functor(d_giants.raw(),
+		                                                first_idx - new_origin));
+	}
+
+	hd_size held_count = m_held.size();
+	if( held_count ) {
+		device_vector_wrapper<int>      d_keep(held_count);
+		device_vector_wrapper<hd_index> d_survivors(held_count);
+		sycl::impl::for_each(execution_policy,
+		                     make_counting_iterator<unsigned int>(0),
+		                     make_counting_iterator<unsigned int>(held_count),
+		                     retreat_candidates_functor(m_held.raw(),
+		                                                new_origin - m_origin,
+		                                                first_idx - m_origin,
+		                                                get_raw_pointer(&d_keep[0])));
+		hd_size survivor_count =
+			sycl::impl::copy_if(execution_policy,
+			                    make_counting_iterator<hd_index>(0),
+			                    make_counting_iterator<hd_index>(held_count),
+			                    d_keep.begin(), // the stencil
+			                    d_survivors.begin(),
+			                    std::identity())
+			- d_survivors.begin();
+		CandidateTable d_kept;
+		m_held.gather(get_raw_pointer(&d_survivors[0]), survivor_count, d_kept);
+		d_giants.append(d_kept);
+		m_held.clear();
+	}
+	m_origin = new_origin;
+
+	return HD_NO_ERROR;
+}
+
+CandidateHold CandidateFrontier::hold(hd_size processed_end,
+                                      hd_size horizon) const {
+	// Clusters reaching within horizon of the end may join the next gulp's
+	//   giants; those reaching back before the next origin cannot be held
+	hd_size hold_from   = processed_end > horizon ? processed_end - horizon : 0;
+	hd_size next_origin = processed_end > m_span ? processed_end - m_span : 0;
+	CandidateHold result;
+	result.hold_from    = hold_from   > m_origin ? hold_from   - m_origin : 0;
+	result.force_before = next_origin > m_origin ? next_origin - m_origin : 0;
+	return result;
+}
@@ -0,0 +1,226 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#if __has_include(<sycl/sycl.hpp>)
+#include <sycl/sycl.hpp>
+#else
+#include <CL/sycl.hpp>
+#endif
+
+#include "hd/candidate_table.h"
+#include "hd/utils.hpp"
+
+#include <boost/iterator/counting_iterator.hpp>
+#include <sycl/algorithm/for_each.hpp>
+
+// Copies row map[i] (or offset+i when map is null) of in to row i of out
+struct copy_candidates_functor {
+	ConstRawCandidates in;
+	RawCandidates      out;
+	const hd_index*    map;
+	hd_size            offset;
+	copy_candidates_functor(ConstRawCandidates in_, RawCandidates out_,
+	                        const hd_index* map_, hd_size offset_=0)
+		: in(in_), out(out_), map(map_), offset(offset_) {}
+	inline void operator()(unsigned int i) const {
+		hd_size j = map ? (hd_size)map[i] : offset + i;
+		out.peaks[i]       = in.peaks[j];
+		out.inds[i]        = in.inds[j];
+		out.begins[i]      = in.begins[j];
+		out.ends[i]        = in.ends[j];
+		out.filter_inds[i] = in.filter_inds[j];
+		out.dm_inds[i]     = in.dm_inds[j];
+		out.members[i]     = in.members[j];
+	}
+};
+
+void CandidateTable::clear() {
+	peaks.clear();
+	inds.clear();
+	begins.clear();
+	ends.clear();
+	filter_inds.clear();
+	dm_inds.clear();
+	members.clear();
+}
+
+void CandidateTable::resize(hd_size count) {
+	peaks.resize(count);
+	inds.resize(count);
+	begins.resize(count);
+	ends.resize(count);
+	filter_inds.resize(count);
+	dm_inds.resize(count);
+	members.resize(count);
+}
+
+RawCandidates CandidateTable::raw(hd_size offset) {
+	using heimdall::util::get_raw_pointer;
+	RawCandidates r;
+	r.peaks       = get_raw_pointer(&peaks[0])       + offset;
+	r.inds        = get_raw_pointer(&inds[0])        + offset;
+	r.begins      = get_raw_pointer(&begins[0])      + offset;
+	r.ends        = get_raw_pointer(&ends[0])        + offset;
+	r.filter_inds = get_raw_pointer(&filter_inds[0]) + offset;
+	r.dm_inds     = get_raw_pointer(&dm_inds[0])     + offset;
+	r.members     = get_raw_pointer(&members[0])     + offset;
+	return r;
+}
+
+ConstRawCandidates CandidateTable::raw(hd_size offset) const {
+	RawCandidates r = const_cast<CandidateTable*>(this)->raw(offset);
+	ConstRawCandidates c;
+	c.peaks       = r.peaks;
+	c.inds        = r.inds;
+	c.begins      = r.begins;
+	c.ends        = r.ends;
+	c.filter_inds = r.filter_inds;
+	c.dm_inds     = r.dm_inds;
+	c.members     = r.members;
+	return c;
+}
+
+void CandidateTable::append(const CandidateTable& other) {
+	hd_size count = other.size();
+	if( count == 0 ) {
+		return;
+	}
+	hd_size old_size = this->size();
+	this->resize(old_size + count);
+	sycl::impl::for_each(execution_policy,
+	                     boost::iterators::make_counting_iterator<unsigned int>(0),
+	                     boost::iterators::make_counting_iterator<unsigned int>(count),
+	                     copy_candidates_functor(other.raw(), this->raw(old_size),
+	                                             0));
+}
+
+void CandidateTable::gather(const hd_index* d_map, hd_size count,
+                            CandidateTable& out) const {
+	out.resize(count);
+	if( count == 0 ) {
+		return;
+	}
+	sycl::impl::for_each(execution_policy,
+	                     boost::iterators::make_counting_iterator<unsigned int>(0),
+	                     boost::iterators::make_counting_iterator<unsigned int>(count),
+	                     copy_candidates_functor(this->raw(), out.raw(), d_map));
+}
+
+void CandidateTable::swap(CandidateTable& other) {
+	std::swap(peaks,       other.peaks);
+	std::swap(inds,        other.inds);
+	std::swap(begins,      other.begins);
+	std::swap(ends,        other.ends);
+	std::swap(filter_inds, other.filter_inds);
+	std::swap(dm_inds,     other.dm_inds);
+	std::swap(members,     other.members);
+}
+
+void CandidateTable::permute(device_vector_wrapper<hd_index>& d_perm) {
+	CandidateTable permuted;
+	this->gather(heimdall::util::get_raw_pointer(&d_perm[0]), d_perm.size(),
+	             permuted);
+	this->swap(permuted);
+}
+
+void HostCandidateTable::clear() {
+	this->resize(0);
+}
+
+void HostCandidateTable::resize(hd_size count) {
+	peaks.resize(count);
+	inds.resize(count);
+	begins.resize(count);
+	ends.resize(count);
+	filter_inds.resize(count);
+	dm_inds.resize(count);
+	members.resize(count);
+	dms.resize(count);
+}
+
+ConstRawCandidates HostCandidateTable::raw(hd_size offset) const {
+	ConstRawCandidates c;
+	c.peaks       = peaks.data()       + offset;
+	c.inds        = inds.data()        + offset;
+	c.begins      = begins.data()      + offset;
+	c.ends        = ends.data()        + offset;
+	c.filter_inds = filter_inds.data() + offset;
+	c.dm_inds     = dm_inds.data()     + offset;
+	c.members     = members.data()     + offset;
+	return c;
+}
+
+void HostCandidateTable::gather(const hd_index* map, hd_size count,
+                                HostCandidateTable& out) const {
+	out.resize(count);
+	for( hd_size i=0; i<count; ++i ) {
+		hd_index j = map[i];
+		out.peaks[i]       = peaks[j];
+		out.inds[i]        = inds[j];
+		out.begins[i]      = begins[j];
+		out.ends[i]        = ends[j];
+		out.filter_inds[i] = filter_inds[j];
+		out.dm_inds[i]     = dm_inds[j];
+		out.members[i]     = members[j];
+		out.dms[i]         = dms[j];
+	}
+}
+
+hd_error copy_to_host(const CandidateTable& d_table,
+                      const hd_float*       dm_list,
+                      HostCandidateTable&   h_table)
+{
+	hd_size count = d_table.size();
+	h_table.resize(count);
+	if( count == 0 ) {
+		return HD_NO_ERROR;
+	}
+	ConstRawCandidates d = d_table.raw();
+	// Note: The copies are all enqueued before waiting once at the end
+	auto queue = execution_policy.get_queue();
+	try {
+		queue.copy(d.peaks,       &h_table.peaks[0],       count);
+		queue.copy(d.inds,        &h_table.inds[0],        count);
+		queue.copy(d.begins,      &h_table.begins[0],      count);
+		queue.copy(d.ends,        &h_table.ends[0],        count);
+		queue.copy(d.filter_inds, &h_table.filter_inds[0], count);
+		queue.copy(d.dm_inds,     &h_table.dm_inds[0],     count);
+		queue.copy(d.members,     &h_table.members[0],     count);
+		queue.wait_and_throw();
+	} catch (sycl::exception& e) {
+		return HD_MEM_COPY_FAILED;
+	}
+	for( hd_size i=0; i<count; ++i ) {
+		h_table.dms[i] = dm_list[h_table.dm_inds[i]];
+	}
+	return HD_NO_ERROR;
+}
+
+hd_error copy_to_device(const HostCandidateTable& h_table,
+                        CandidateTable&           d_table)
+{
+	hd_size count = h_table.size();
+	d_table.resize(count);
+	if( count == 0 ) {
+		return HD_NO_ERROR;
+	}
+	RawCandidates d = d_table.raw();
+	auto queue = execution_policy.get_queue();
+	try {
+		queue.copy(&h_table.peaks[0],       d.peaks,       count);
+		queue.copy(&h_table.inds[0],        d.inds,        count);
+		queue.copy(&h_table.begins[0],      d.begins,      count);
+		queue.copy(&h_table.ends[0],        d.ends,        count);
+		queue.copy(&h_table.filter_inds[0], d.filter_inds, count);
+		queue.copy(&h_table.dm_inds[0],     d.dm_inds,     count);
+		queue.copy(&h_table.members[0],     d.members,     count);
+		queue.wait_and_throw();
+	} catch (sycl::exception& e) {
+		return HD_MEM_COPY_FAILED;
+	}
+	return HD_NO_ERROR;
+}
@@ -18,8 +18,10 @@
 #include "hd/measure_bandpass.h"
 #include "hd/matched_filter.h"
 #include "hd/utils.hpp"
+#include "hd/bitpack.h"
 
 #include <vector>
+#include <algorithm>
 #include <dedisp.h>
 #ifdef HAVE_MPI
 #include <mpi.h>
@@ -51,22 +53,21 @@ struct abs_less_than {
   }
 };
 
-template <typename WordType>
+template <int NBITS, typename WordType>
 struct zap_fb_rfi_functor {
   // Note: Increasing this trades performance for accuracy
   enum { MAX_RESAMPLE_ATTEMPTS = 10 };
+  enum { chans_per_word = heimdall::bitpack::traits<NBITS,WordType>::samps_per_word };
   const int*      mask;
   const WordType* in;
   unsigned int    stride;
-  unsigned int    nbits;
   unsigned int    nsamps;
   unsigned int    max_resample_dist;
-  WordType        bitmask;
   zap_fb_rfi_functor(const int* mask_, const WordType* in_,
-                     unsigned int stride_, unsigned int nbits_,
+                     unsigned int stride_,
                      unsigned int nsamps_, unsigned int max_resample_dist_)
     : mask(mask_), in(in_),
-      stride(stride_), nbits(nbits_), bitmask((1<<nbits)-1),
+      stride(stride_),
       nsamps(nsamps_), max_resample_dist(max_resample_dist_) {}
   inline WordType operator()(unsigned int i) const {
     // Lift the 1D index into 2D filterbank coords
@@ -83,13 +84,13 @@ struct zap_fb_rfi_functor {
       //          time) in here to ensure good randomness.
       random_engine rng(seed);
       result = 0;
+      unsigned int min_t = t > max_resample_dist ?
+        t - max_resample_dist : 0;
+      unsigned int max_t = t < nsamps-1 - max_resample_dist ?
+        t + max_resample_dist : nsamps-1;
+      uniform_int_distribution<unsigned int> dist(min_t, max_t);
       // Iterate over channels in the word
-      for( int k=0; k<int(sizeof(WordType)*8); k+=nbits ) {
-        unsigned int min_t = t > max_resample_dist ?
-          t - max_resample_dist : 0;
-        unsigned int max_t = t < nsamps-1 - max_resample_dist ?
-          t + max_resample_dist : nsamps-1;
-        uniform_int_distribution<unsigned int> dist(min_t, max_t);
+      for( unsigned int k=0; k<chans_per_word; ++k ) {
         unsigned int new_t = dist(rng);
         // Avoid replacing with another bad sample
         // Note: We must limit the number of attempts here for speed
@@ -98,8 +99,8 @@ struct zap_fb_rfi_functor {
           new_t = dist(rng);
         }
         
-        WordType val = (in[new_t*stride + c] >> k) & bitmask;
-        result |= val << k;
+        WordType val = heimdall::bitpack::extract<NBITS>(in[new_t*stride + c], k);
+        result = heimdall::bitpack::insert<NBITS>(result, k, val);
       }
     }
     else {
@@ -109,32 +110,27 @@ struct zap_fb_rfi_functor {
     return result;
   }
 };
-template <typename WordType>
+template <int NBITS, typename WordType>
 struct zap_narrow_rfi_functor {
   // Note: Increasing this trades performance for accuracy
   enum { MAX_RESAMPLE_ATTEMPTS = 10 };
+  enum { chans_per_word = heimdall::bitpack::traits<NBITS,WordType>::samps_per_word };
   WordType*       data;
   const float*    baseline;
   float           thresh;
   unsigned int    stride;
-  unsigned int    nbits;
   unsigned int    nchans;
   unsigned int    max_resample_dist;
-  WordType        bitmask;
-  unsigned int    chans_per_word;
   zap_narrow_rfi_functor(WordType* data_, const float* baseline_,
                          float thresh_,
-                         unsigned int stride_, unsigned int nbits_,
+                         unsigned int stride_,
                          unsigned int nchans_, unsigned int max_resample_dist_)
     : data(data_), baseline(baseline_), thresh(thresh_),
-      stride(stride_), nbits(nbits_), bitmask((1<<nbits)-1),
-      nchans(nchans_), max_resample_dist(max_resample_dist_),
-      chans_per_word(sizeof(WordType)*8/nbits) {}
+      stride(stride_),
+      nchans(nchans_), max_resample_dist(max_resample_dist_) {}
 
   inline WordType sample(unsigned int t, unsigned int c) const {
-    unsigned int w = c / chans_per_word;
-    unsigned int k = c % chans_per_word;
-    return (data[t*stride + w] >> (k*nbits)) & bitmask;
+    return heimdall::bitpack::sample<NBITS>(&data[t*stride], c);
   }
 
   inline void operator()(unsigned int i) const {
@@ -154,8 +150,8 @@ struct zap_narrow_rfi_functor {
     bool any_bad = false;
     // Iterate over channels in the word
     for( unsigned int k=0; k<chans_per_word; ++k ) {
-      unsigned int c = w + k;
-      WordType val = (word >> (k*nbits)) & bitmask;
+      unsigned int c = w*chans_per_word + k;
+      WordType val = heimdall::bitpack::extract<NBITS>(word, k);
       if( fabs(val - baseline[c]) > thresh ) {
         any_bad = true;
         
@@ -177,8 +173,7 @@ struct zap_narrow_rfi_functor {
           new_val = sample(t, new_c);
         }
         // Replace the relevant bits
-        word &= ~(bitmask << (k*nbits));
-        word |= new_val << (k*nbits);
+        word = heimdall::bitpack::insert<NBITS>(word, k, new_val);
       }
     }
     if( any_bad ) {
@@ -216,13 +211,18 @@ hd_error zap_filterbank_rfi(const int* h_mask, const hd_byte* h_in,
   WordType *d_in_ptr = heimdall::util::get_raw_pointer(&d_in[0]);
   int *d_mask_ptr = heimdall::util::get_raw_pointer(&d_mask[0]);
   
-  sycl::impl::transform(
-      execution_policy,
-      boost::iterators::counting_iterator<unsigned int>(0),
-      boost::iterators::counting_iterator<unsigned int>(nsamps * stride),
-      d_out.begin(),
-      zap_fb_rfi_functor<WordType>(d_mask_ptr, d_in_ptr, stride, nbits, nsamps,
-                                   max_resample_dist));
+  bool supported = heimdall::bitpack::dispatch(nbits, [&](auto nbits_c) {
+    sycl::impl::transform(
+        execution_policy,
+        boost::iterators::counting_iterator<unsigned int>(0),
+        boost::iterators::counting_iterator<unsigned int>(nsamps * stride),
+        d_out.begin(),
+        zap_fb_rfi_functor<decltype(nbits_c)::value, WordType>(
+            d_mask_ptr, d_in_ptr, stride, nsamps, max_resample_dist));
+  });
+  if( !supported ) {
+    return HD_INVALID_NBITS;
+  }
   // Copy back to the host
   heimdall::util::copy(d_out, (WordType *)h_out);
 
@@ -260,9 +260,13 @@ hd_error clean_filterbank_rfi(dedisp_plan    main_plan,
                               hd_size        rfi_min_beams,
                               bool           rfi_broad,
                               bool           rfi_narrow,
-                              hd_size        boxcar_max)
+                              hd_size        boxcar_max,
+                              hd_size*       nsamps_zapped)
 {
   hd_error error;
+  if( nsamps_zapped ) {
+    *nsamps_zapped = 0;
+  }
   
   typedef hd_float out_type;
   std::vector<out_type>           h_raw_series;
@@ -315,17 +319,19 @@ hd_error clean_filterbank_rfi(dedisp_plan    main_plan,
                        nsamps_gulp, nchans, nbits,
                        d_bandpass_ptr, &rms);
       
-      zap_narrow_rfi_functor<WordType> zapit(d_in_ptr,
-                                             d_bandpass_ptr,
-                                             rfi_tol*rms,
-                                             stride, nbits, nchans,
-                                             max_chan_resample_dist);
-      
       // Zap narrow-band RFI
       boost::iterators::counting_iterator<unsigned int> begin(g*stride);
       boost::iterators::counting_iterator<unsigned int> end((g+nsamps_gulp)*stride);
-      sycl::impl::for_each(execution_policy,
-          begin, end, zapit);
+      bool supported = heimdall::bitpack::dispatch(nbits, [&](auto nbits_c) {
+        zap_narrow_rfi_functor<decltype(nbits_c)::value, WordType>
+          zapit(d_in_ptr, d_bandpass_ptr, rfi_tol*rms,
+                stride, nchans, max_chan_resample_dist);
+        sycl::impl::for_each(execution_policy,
+            begin, end, zapit);
+      });
+      if( !supported ) {
+        return HD_INVALID_NBITS;
+      }
     }
     
     h_in_copy.resize(nsamps*stride*sizeof(WordType));
@@ -472,6 +478,10 @@ hd_error clean_filterbank_rfi(dedisp_plan    main_plan,
     }
     // h_rfi_mask = d_rfi_mask;
     heimdall::util::copy(d_rfi_mask, h_rfi_mask);
+    if( nsamps_zapped ) {
+      *nsamps_zapped = h_rfi_mask.size() -
+        std::count(h_rfi_mask.begin(), h_rfi_mask.end(), 0);
+    }
     // -------------------------------------
     
     // Finally, apply the mask to zap RFI in the filterbank
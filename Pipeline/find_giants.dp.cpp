@@ -68,17 +68,13 @@ template <typename T> struct plus_one {
 
 class GiantFinder_impl {
   device_vector_wrapper<hd_float> d_giant_data;
-  device_vector_wrapper<hd_size> d_giant_data_inds;
+  device_vector_wrapper<hd_index> d_giant_data_inds;
   device_vector_wrapper<hd_size> d_giant_data_segments;
   device_vector_wrapper<hd_size> d_giant_data_seg_ids;
 
 public:
   hd_error exec(const hd_float *d_data, hd_size count, hd_float thresh,
-                hd_size merge_dist,
-                device_vector_wrapper<hd_float> &d_giant_peaks,
-                device_vector_wrapper<hd_size> &d_giant_inds,
-                device_vector_wrapper<hd_size> &d_giant_begins,
-                device_vector_wrapper<hd_size> &d_giant_ends) {
+                hd_size merge_dist, CandidateTable &d_giants) {
     // This algorithm works by extracting all samples in the time series
     //   above thresh (the giant_data), segmenting those samples into
     //   isolated giants (based on merge_dist), and then computing the
@@ -88,7 +84,7 @@ public:
     typedef heimdall::util::device_pointer<const hd_float> const_float_ptr;
     // typedef thrust::system::cuda::pointer<const hd_float> const_float_ptr;
     typedef heimdall::util::device_pointer<hd_float> float_ptr;
-    typedef heimdall::util::device_pointer<hd_size> size_ptr;
+    typedef heimdall::util::device_pointer<hd_index> index_ptr;
 
     /*const_*/float_ptr d_data_begin(const_cast<hd_float*>(d_data));
     /*const_*/float_ptr d_data_end(const_cast<hd_float*>(d_data) + count);
@@ -203,7 +199,7 @@ public:
         execution_policy,
         d_giant_data_inds.begin(),
         d_giant_data_inds.end(),
-        d_giant_data_segments.begin(), not_nearby<hd_size>(merge_dist));
+        d_giant_data_segments.begin(), not_nearby<hd_index>(merge_dist));
 
     // hd_size giant_count_quick = thrust::count(d_giant_data_segments.begin(),
     //                                          d_giant_data_segments.end(),
@@ -246,16 +242,13 @@ public:
     timer.start();
 #endif
 
-    hd_size new_giants_offset = d_giant_peaks.size();
-    // Allocate space for the new giants
-    d_giant_peaks.resize(d_giant_peaks.size() + giant_count);
-    d_giant_inds.resize(d_giant_inds.size() + giant_count);
-    d_giant_begins.resize(d_giant_begins.size() + giant_count);
-    d_giant_ends.resize(d_giant_ends.size() + giant_count);
-    float_ptr new_giant_peaks_begin(&d_giant_peaks[new_giants_offset]);
-    size_ptr new_giant_inds_begin(&d_giant_inds[new_giants_offset]);
-    size_ptr new_giant_begins_begin(&d_giant_begins[new_giants_offset]);
-    size_ptr new_giant_ends_begin(&d_giant_ends[new_giants_offset]);
+    hd_size new_giants_offset = d_giants.size();
+    // Allocate space for the new giants (all columns at once)
+    d_giants.resize(new_giants_offset + giant_count);
+    float_ptr new_giant_peaks_begin(&d_giants.peaks[new_giants_offset]);
+    index_ptr new_giant_inds_begin(&d_giants.inds[new_giants_offset]);
+    index_ptr new_giant_begins_begin(&d_giants.begins[new_giants_offset]);
+    index_ptr new_giant_ends_begin(&d_giants.ends[new_giants_offset]);
 
 #ifdef PRINT_BENCHMARKS
     dpct::get_default_queue().wait();
@@ -277,7 +270,7 @@ public:
                     thrust::make_discard_iterator(), // the keys output
                     make_zip_iterator(make_tuple(thrust::retag<my_tag>(new_giant_peaks_begin),
                                                  thrust::retag<my_tag>(new_giant_inds_begin))),
-                    nearby<hd_size>(merge_dist),
+                    nearby<hd_index>(merge_dist),
                     maximum_first<thrust::tuple<hd_float,hd_size> >())
       .second - make_zip_iterator(make_tuple(thrust::retag<my_tag>(new_giant_peaks_begin),
                                              thrust::retag<my_tag>(new_giant_inds_begin)));
@@ -290,7 +283,7 @@ public:
             d_giant_data.begin(),
             new_giant_inds_begin, // the keys output
             new_giant_peaks_begin,
-            nearby<hd_size>(merge_dist),
+            nearby<hd_index>(merge_dist),
             maximum_first<hd_float>())
             .second -
         new_giant_peaks_begin;
@@ -316,13 +309,13 @@ public:
                d_giant_data_seg_ids.begin(), d_giant_data_segments.begin(),
                new_giant_begins_begin);
     sycl::impl::scatter_if(execution_policy,
-        boost::iterators::make_transform_iterator(d_giant_data_inds.begin(), plus_one<hd_size>()),
-        boost::iterators::make_transform_iterator(d_giant_data_inds.end() - 1, plus_one<hd_size>()),
+        boost::iterators::make_transform_iterator(d_giant_data_inds.begin(), plus_one<hd_index>()),
+        boost::iterators::make_transform_iterator(d_giant_data_inds.end() - 1, plus_one<hd_index>()),
         d_giant_data_seg_ids.begin(), d_giant_data_segments.begin() + 1,
         new_giant_ends_begin);
 
     if (giant_count > 0) {
-      d_giant_ends.back() = d_giant_data_inds.back() + 1;
+      d_giants.ends.back() = d_giant_data_inds.back() + 1;
     }
 
 #ifdef PRINT_BENCHMARKS
@@ -344,10 +337,6 @@ GiantFinder::GiantFinder()
   : m_impl(new GiantFinder_impl) {}
 hd_error GiantFinder::exec(const hd_float *d_data, hd_size count,
                            hd_float thresh, hd_size merge_dist,
-                           device_vector_wrapper<hd_float> &d_giant_peaks,
-                           device_vector_wrapper<hd_size> &d_giant_inds,
-                           device_vector_wrapper<hd_size> &d_giant_begins,
-                           device_vector_wrapper<hd_size> &d_giant_ends) {
-  return m_impl->exec(d_data, count, thresh, merge_dist, d_giant_peaks,
-                      d_giant_inds, d_giant_begins, d_giant_ends);
+                           CandidateTable &d_giants) {
+  return m_impl->exec(d_data, count, thresh, merge_dist, d_giants);
 }
@@ -17,11 +17,6 @@
 
 #include <dpct/dpl_extras/iterators.h>
 
-template <typename T>
-struct absolute_val {
-        inline T operator()(T x) const { return abs(x); }
-};
-
 class GetRMSPlan_impl {
         device_vector_wrapper<hd_float> buf1;
         device_vector_wrapper<hd_float> buf2;
@@ -36,16 +31,14 @@ public:
 		//   to approximate the median absolute deviation. The RMS is then
 		//   just 1.4862 times this.
 		
-		buf1.resize(count);
-		buf2.resize(count/5);
+		// Note: The absolute value is fused into the first scrunch
+		buf1.resize(count/5 + 1);
+		buf2.resize(count/25 + 1);
         hd_float *buf1_ptr = heimdall::util::get_raw_pointer(&buf1[0]);
         hd_float *buf2_ptr = heimdall::util::get_raw_pointer(&buf2[0]);
 
-        sycl::impl::transform(execution_policy,
-                               d_data_begin, d_data_begin + count, buf1.begin(),
-                               absolute_val<hd_float>());
-
-        for( hd_size size=count; size>1; size/=5 ) {
+        median_scrunch5_abs(d_data, count, buf1_ptr);
+        for( hd_size size=count/5; size>1; size/=5 ) {
 			median_scrunch5(buf1_ptr, size, buf2_ptr);
 			std::swap(buf1_ptr, buf2_ptr);
 		}
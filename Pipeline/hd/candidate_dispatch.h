@@ -0,0 +1,92 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#pragma once
+
+#include <limits>
+
+#include "hd/types.h"
+#include "hd/error.h"
+#include "hd/params.h"
+#include "hd/candidate_table.h"
+
+class ThreadPool;
+class CandidateFilter;
+
+// Where the candidate grouping algorithms are run
+enum hd_exec_target {
+	HD_EXEC_HOST_SERIAL,
+	HD_EXEC_HOST_PARALLEL,
+	HD_EXEC_DEVICE
+};
+
+const char* hd_get_exec_target_string(hd_exec_target target);
+
+// Giant counts at which grouping moves from a single host thread to the
+//   host thread pool, and from the host to the device
+struct CandidateDispatch {
+	hd_size parallel_min;
+	hd_size device_min;
+	CandidateDispatch()
+		: parallel_min(std::numeric_limits<hd_size>::max()), device_min(0) {}
+	CandidateDispatch(hd_size parallel_min_, hd_size device_min_)
+		: parallel_min(parallel_min_), device_min(device_min_) {}
+
+	hd_exec_target select(hd_size count) const {
+		if( count >= device_min ) {
+			return HD_EXEC_DEVICE;
+		}
+		if( count >= parallel_min ) {
+			return HD_EXEC_HOST_PARALLEL;
+		}
+		return HD_EXEC_HOST_SERIAL;
+	}
+};
+
+// Clusters that may still grow are held back instead of being merged:
+//   those with a member at or after hold_from, unless they began before
+//   force_before (which bounds how long a cluster can be held)
+struct CandidateHold {
+	hd_index hold_from;
+	hd_index force_before;
+	inline bool is_held(hd_index first, hd_index last) const {
+		return last >= hold_from && first >= force_before;
+	}
+};
+
+// Labels coincident giants and merges each cluster into a group on the
+//   given target, leaving the groups (and their DMs) in host memory
+// If hold and d_held are given, the giants of held clusters are moved to
+//   d_held (in device memory) instead of being grouped
+// If filter is given, groups for which it is false are dropped before they
+//   are copied to the host (origin being the absolute sample of index 0)
+// Note: The host targets first copy d_giants to the host, which for small
+//         counts is far cheaper than the device sorts and reductions
+// Note: The device target modifies d_giants.members
+hd_error group_candidates(hd_exec_target       target,
+                          ThreadPool*          pool,
+                          hd_size              nthreads,
+                          CandidateTable&      d_giants,
+                          const hd_float*      dm_list,
+                          hd_size              time_tol,
+                          hd_size              filter_tol,
+                          hd_size              dm_tol,
+                          HostCandidateTable&  h_groups,
+                          const CandidateHold*   hold=0,
+                          CandidateTable*        d_held=0,
+                          const CandidateFilter* filter=0,
+                          hd_size                origin=0);
+
+// Times group_candidates on each target for a range of synthetic giant
+//   counts and sets dispatch to the observed crossover points
+// Note: pool may be null, in which case the host-parallel target is never
+//         selected
+hd_error calibrate_candidate_dispatch(const hd_params&   params,
+                                      const hd_float*    dm_list,
+                                      hd_size            dm_count,
+                                      ThreadPool*        pool,
+                                      CandidateDispatch* dispatch);
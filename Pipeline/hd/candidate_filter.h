@@ -0,0 +1,164 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+/*
+  Declarative filtering of candidate groups, e.g.,
+    snr>7 && dm>1.5 && members>=3 && width<=2^10
+
+  Variables:
+    snr       Peak signal-to-noise ratio
+    dm        Dispersion measure (pc cm^-3)
+    dm_trial  DM trial index
+    members   No. giants merged into the group
+    filter    Boxcar filter index
+    width     Boxcar filter width in samples (2^filter)
+    samp      Absolute sample index of the peak
+    time      Time of the peak in seconds (samp * dt)
+    begin     Absolute sample index of the start of the group
+    end       Absolute sample index of the end of the group
+
+  Operators (loosest binding first): ||  &&  < <= > >= == !=  + -  * /
+    unary - !  ^ (right associative), plus parentheses.
+
+  Expressions are compiled once to a fixed-size postfix program that can
+    be evaluated in a SYCL kernel or on the host.
+  Note: Values are evaluated in single precision, so comparisons of samp,
+          begin, end and time are approximate beyond 2^24 samples.
+ */
+
+#pragma once
+
+#if __has_include(<sycl/sycl.hpp>)
+#include <sycl/sycl.hpp>
+#else
+#include <CL/sycl.hpp>
+#endif
+
+#include <string>
+#include <vector>
+
+#include "hd/types.h"
+#include "hd/error.h"
+#include "hd/candidate_table.h"
+
+enum {
+	HD_FILTER_VAR_SNR,
+	HD_FILTER_VAR_DM,
+	HD_FILTER_VAR_DM_TRIAL,
+	HD_FILTER_VAR_MEMBERS,
+	HD_FILTER_VAR_FILTER,
+	HD_FILTER_VAR_WIDTH,
+	HD_FILTER_VAR_SAMP,
+	HD_FILTER_VAR_TIME,
+	HD_FILTER_VAR_BEGIN,
+	HD_FILTER_VAR_END,
+	HD_FILTER_VAR_COUNT
+};
+
+enum {
+	HD_FILTER_OP_CONST,
+	HD_FILTER_OP_VAR,
+	HD_FILTER_OP_NEG,
+	HD_FILTER_OP_NOT,
+	HD_FILTER_OP_ADD,
+	HD_FILTER_OP_SUB,
+	HD_FILTER_OP_MUL,
+	HD_FILTER_OP_DIV,
+	HD_FILTER_OP_POW,
+	HD_FILTER_OP_LT,
+	HD_FILTER_OP_LE,
+	HD_FILTER_OP_GT,
+	HD_FILTER_OP_GE,
+	HD_FILTER_OP_EQ,
+	HD_FILTER_OP_NE,
+	HD_FILTER_OP_AND,
+	HD_FILTER_OP_OR
+};
+
+// Postfix program; trivially copyable so that it can be passed to kernels
+struct CandidateFilterProgram {
+	enum { MAX_OPS = 64, MAX_STACK = 16 };
+	int      op_count;
+	int      ops[MAX_OPS];
+	hd_float args[MAX_OPS]; // Constant value or variable index
+
+	inline bool eval(const hd_float* vars) const {
+		hd_float stack[MAX_STACK];
+		int      top = 0;
+		for( int k=0; k<op_count; ++k ) {
+			int op = ops[k];
+			if( op == HD_FILTER_OP_CONST ) {
+				stack[top++] = args[k];
+				continue;
+			}
+			if( op == HD_FILTER_OP_VAR ) {
+				stack[top++] = vars[(int)args[k]];
+				continue;
+			}
+			if( op == HD_FILTER_OP_NEG ) {
+				stack[top-1] = -stack[top-1];
+				continue;
+			}
+			if( op == HD_FILTER_OP_NOT ) {
+				stack[top-1] = stack[top-1] == 0;
+				continue;
+			}
+			hd_float b = stack[--top];
+			hd_float a = stack[top-1];
+			hd_float r;
+			switch( op ) {
+			case HD_FILTER_OP_ADD: r = a + b; break;
+			case HD_FILTER_OP_SUB: r = a - b; break;
+			case HD_FILTER_OP_MUL: r = a * b; break;
+			case HD_FILTER_OP_DIV: r = a / b; break;
+			case HD_FILTER_OP_POW: r = sycl::pow(a, b); break;
+			case HD_FILTER_OP_LT:  r = a <  b; break;
+			case HD_FILTER_OP_LE:  r = a <= b; break;
+			case HD_FILTER_OP_GT:  r = a >  b; break;
+			case HD_FILTER_OP_GE:  r = a >= b; break;
+			case HD_FILTER_OP_EQ:  r = a == b; break;
+			case HD_FILTER_OP_NE:  r = a != b; break;
+			case HD_FILTER_OP_AND: r = (a != 0) && (b != 0); break;
+			case HD_FILTER_OP_OR:  r = (a != 0) || (b != 0); break;
+			default:               r = 0; break;
+			}
+			stack[top-1] = r;
+		}
+		return op_count == 0 || stack[0] != 0;
+	}
+};
+
+// A compiled candidate filter together with what it needs to evaluate the
+//   derived variables (the DM list and sampling time)
+class CandidateFilter {
+public:
+	CandidateFilter() : m_dt(0) { m_program.op_count = 0; }
+
+	// Compiles expr (which may be null or empty to accept everything)
+	// Note: On failure, a description of the problem is left in message
+	hd_error compile(const char* expr, std::string* message=0);
+	// Combines the current program with another expression using &&
+	hd_error require(const char* expr, std::string* message=0);
+
+	// Sets the DM list (copied to the device) and the sampling time
+	void set_observation(const hd_float* dm_list, hd_size dm_count,
+	                     hd_float dt);
+
+	bool empty() const { return m_program.op_count == 0; }
+
+	// Removes the groups for which the expression is false, in place
+	// Note: origin is the absolute sample index of the groups' index 0
+	hd_error apply(CandidateTable&     d_groups, hd_size origin) const;
+	hd_error apply(HostCandidateTable& h_groups, hd_size origin) const;
+
+private:
+	CandidateFilterProgram          m_program;
+	std::string                     m_expr;
+	std::vector<hd_float>           m_h_dm_list;
+	device_vector_wrapper<hd_float> m_dm_list;
+	hd_float                        m_dt;
+};
@@ -0,0 +1,46 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#pragma once
+
+#include "hd/types.h"
+#include "hd/error.h"
+#include "hd/candidate_table.h"
+#include "hd/candidate_dispatch.h"
+
+// Giants of clusters that could still grow at the end of a gulp, carried
+//   over to be clustered together with the next gulp's giants, so that
+//   pulses straddling a gulp boundary are grouped (and reported) once.
+// Note: Sample indices in the frontier, and in giants that have been merged
+//         into it, are relative to origin(), which trails the start of the
+//         current gulp by at most span samples.
+class CandidateFrontier {
+public:
+	CandidateFrontier() : m_origin(0), m_span(0) {}
+
+	// span bounds how far back a held cluster may reach; it must exceed
+	//   the largest time tolerance used in clustering
+	void set_span(hd_size span) { m_span = span; }
+
+	// Moves the indices of d_giants (relative to first_idx) and of the held
+	//   giants onto a new origin, and appends the held giants to d_giants
+	// Note: Held giants at or after first_idx are discarded, as the new gulp
+	//         will have found them again
+	hd_error merge_into(hd_size first_idx, CandidateTable& d_giants);
+
+	// Returns the hold for clustering giants up to processed_end (absolute)
+	//   with the given maximum time tolerance
+	CandidateHold hold(hd_size processed_end, hd_size horizon) const;
+
+	hd_size         origin() const { return m_origin; }
+	CandidateTable& held()         { return m_held; }
+
+private:
+	CandidateTable m_held;
+	hd_size        m_origin;
+	hd_size        m_span;
+};
@@ -0,0 +1,107 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#pragma once
+
+#if __has_include(<sycl/sycl.hpp>)
+#include <sycl/sycl.hpp>
+#else
+#include <CL/sycl.hpp>
+#endif
+
+#include <vector>
+
+#include <sycl/algorithm/iota.hpp>
+
+#include "hd/types.h"
+#include "hd/error.h"
+#include "hd/utils.hpp"
+
+// Structure-of-arrays container for candidates (giants or groups) in device
+//   memory. All columns are always the same length and are resized, copied
+//   and permuted together, each in a single kernel.
+// Note: Sample indices (inds, begins, ends) are relative to the start of
+//         the gulp.
+struct CandidateTable {
+	device_vector_wrapper<hd_float> peaks;
+	device_vector_wrapper<hd_index> inds;
+	device_vector_wrapper<hd_index> begins;
+	device_vector_wrapper<hd_index> ends;
+	device_vector_wrapper<hd_index> filter_inds;
+	device_vector_wrapper<hd_index> dm_inds;
+	device_vector_wrapper<hd_index> members;
+
+	hd_size size()  const { return peaks.size(); }
+	bool    empty() const { return peaks.empty(); }
+	void    clear();
+	void    resize(hd_size count);
+
+	// Pointers to the columns, starting at row offset
+	// Note: Only valid while the table is not resized
+	RawCandidates      raw(hd_size offset=0);
+	ConstRawCandidates raw(hd_size offset=0) const;
+
+	// Exchanges the contents of the two tables without copying
+	void swap(CandidateTable& other);
+	// Appends all rows of other to this table
+	void append(const CandidateTable& other);
+	// Resizes out to count rows and sets out[i] = this[d_map[i]]
+	void gather(const hd_index* d_map, hd_size count,
+	            CandidateTable& out) const;
+	// Sorts the rows by d_keys (which is sorted in place)
+	// Note: The sort is not stable
+	template<typename KeyType>
+	void sort_by_key(device_vector_wrapper<KeyType>& d_keys);
+
+private:
+	void permute(device_vector_wrapper<hd_index>& d_perm);
+};
+
+// Host-side copy of a CandidateTable, plus derived quantities
+struct HostCandidateTable {
+	std::vector<hd_float> peaks;
+	std::vector<hd_index> inds;
+	std::vector<hd_index> begins;
+	std::vector<hd_index> ends;
+	std::vector<hd_index> filter_inds;
+	std::vector<hd_index> dm_inds;
+	std::vector<hd_index> members;
+	std::vector<hd_float> dms;
+
+	hd_size size() const { return peaks.size(); }
+	void    clear();
+	void    resize(hd_size count);
+
+	ConstRawCandidates raw(hd_size offset=0) const;
+
+	// Resizes out to count rows and sets out[i] = this[map[i]]
+	void gather(const hd_index* map, hd_size count,
+	            HostCandidateTable& out) const;
+};
+
+// Copies all columns of d_table to h_table, waiting only once, and looks up
+//   each row's DM in dm_list
+hd_error copy_to_host(const CandidateTable& d_table,
+                      const hd_float*       dm_list,
+                      HostCandidateTable&   h_table);
+
+// Copies all columns of h_table to d_table, waiting only once
+hd_error copy_to_device(const HostCandidateTable& h_table,
+                        CandidateTable&           d_table);
+
+template<typename KeyType>
+void CandidateTable::sort_by_key(device_vector_wrapper<KeyType>& d_keys) {
+	if( this->empty() ) {
+		return;
+	}
+	device_vector_wrapper<hd_index> d_perm(this->size());
+	sycl::impl::iota(execution_policy, d_perm.begin(), d_perm.end());
+	sycl::impl::sort_by_key(execution_policy,
+	                        d_keys.begin(), d_keys.end(), d_perm.begin(),
+	                        std::less());
+	this->permute(d_perm);
+}
@@ -24,7 +24,9 @@ hd_error clean_filterbank_rfi(dedisp_plan    plan,
                               hd_size        rfi_min_beams,
                               bool           rfi_broad,
                               bool           rfi_narrow,
-                              hd_size        boxcar_max);
+                              hd_size        boxcar_max,
+                              // If given, set to the no. samples zapped
+                              hd_size*       nsamps_zapped = 0);
 
 hd_error apply_manual_killmasks (dedisp_plan    main_plan,
                                  int*           h_killmask,
@@ -25,6 +25,9 @@ enum {
 	HD_INVALID_POINTER,
 	HD_INVALID_STRIDE,
 	HD_INVALID_NBITS,
+	HD_INVALID_CAND_FILTER,
+	HD_FILE_OPEN_FAILED,
+	HD_FILE_WRITE_FAILED,
 	
 	HD_PRIOR_GPU_ERROR,
 	HD_INTERNAL_GPU_ERROR,
@@ -20,17 +20,17 @@
 #include "hd/types.h"
 #include "hd/error.h"
 #include "hd/utils.hpp"
+#include "hd/candidate_table.h"
 
 struct GiantFinder_impl;
 
 struct GiantFinder {
 	GiantFinder();
+	// Appends the giants found in d_data to d_giants
+	// Note: Only the peaks, inds, begins and ends columns of the new rows
+	//         are filled; the caller is responsible for the others.
         hd_error exec(const hd_float *d_data, hd_size count, hd_float thresh,
-                      hd_size merge_dist,
-                      device_vector_wrapper<hd_float> &d_giant_peaks,
-                      device_vector_wrapper<hd_size> &d_giant_inds,
-                      device_vector_wrapper<hd_size> &d_giant_begins,
-                      device_vector_wrapper<hd_size> &d_giant_ends);
+                      hd_size merge_dist, CandidateTable &d_giants);
 
 private:
 	boost::shared_ptr<GiantFinder_impl> m_impl;
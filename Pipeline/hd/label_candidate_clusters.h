@@ -9,6 +9,8 @@
 
 #include "hd/types.h"
 #include "hd/error.h"
+
+class ThreadPool;
 /*
 hd_error label_candidate_clusters(hd_size        count,
                                   const hd_size* d_begins,
@@ -41,5 +43,18 @@ hd_error label_candidate_clusters(hd_size            count,
                                   hd_size            time_tol,
                                   hd_size            filter_tol,
                                   hd_size            dm_tol,
-                                  hd_size*           d_labels,
+                                  hd_index*          d_labels,
                                   hd_size*           label_count);
+
+// As above, but for candidates and labels in host memory
+// Note: The work is split over nthreads tasks on pool if one is given,
+//         otherwise it is done serially in the calling thread
+hd_error label_candidate_clusters_host(hd_size            count,
+                                       ConstRawCandidates h_cands,
+                                       hd_size            time_tol,
+                                       hd_size            filter_tol,
+                                       hd_size            dm_tol,
+                                       hd_index*          h_labels,
+                                       hd_size*           label_count,
+                                       ThreadPool*        pool=0,
+                                       hd_size            nthreads=1);
@@ -26,6 +26,11 @@ hd_error median_scrunch5(const hd_float* d_in,
                          hd_size         count,
                          hd_float*       d_out);
 
+// Median-scrunches the absolute values of d_in (single pass)
+hd_error median_scrunch5_abs(const hd_float* d_in,
+                             hd_size         count,
+                             hd_float*       d_out);
+
 // Note: This can operate 'in-place'
 hd_error mean_filter2(const hd_float* d_in,
                       hd_size         count,
@@ -36,6 +41,14 @@ hd_error linear_stretch(const hd_float* d_in,
                         hd_float*       d_out,
                         hd_size         out_count);
 
+// Linearly stretches d_in to stretch_count elements and median-scrunches
+//   the result by 5, without materialising the stretched array
+// Note: stretch_count must be at least 5
+hd_error linear_stretch_median_scrunch5(const hd_float* d_in,
+                                        hd_size         in_count,
+                                        hd_size         stretch_count,
+                                        hd_float*       d_out);
+
 // Median-scrunches the corresponding elements from a collection of arrays
 // Note: This cannot (currently) handle count not being a multiple of 3
 hd_error median_scrunch3_array(const hd_float* d_in,
@@ -9,8 +9,20 @@
 
 #include "hd/types.h"
 #include "hd/error.h"
+#include "hd/candidate_table.h"
 
-hd_error merge_candidates(hd_size            count,
-                          hd_size*           d_labels,
-                          ConstRawCandidates d_cands,
-                          RawCandidates      d_groups);
+// Merges the candidates in each labelled cluster into a single group,
+//   keeping the brightest member and summing the member counts
+// Note: This modifies d_cands.members
+hd_error merge_candidates(hd_size         count,
+                          hd_index*       d_labels,
+                          CandidateTable& d_cands,
+                          CandidateTable& d_groups);
+
+// As above, but for candidates and labels in host memory
+// Note: h_labels must be flattened, i.e., each the minimum index in its
+//         cluster, as produced by label_candidate_clusters(_host)
+hd_error merge_candidates_host(hd_size                   count,
+                               const hd_index*           h_labels,
+                               const HostCandidateTable& h_cands,
+                               HostCandidateTable&       h_groups);
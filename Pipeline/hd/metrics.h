@@ -0,0 +1,136 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "hd/types.h"
+
+// A counter, gauge or latency histogram, updated lock-free from any thread
+class Metric {
+public:
+	enum Type { COUNTER, GAUGE, HISTOGRAM };
+	// Histogram buckets have upper bounds doubling from 100 us to ~13 s,
+	//   followed by one for everything slower
+	enum { BUCKET_COUNT = 18 };
+	static double bucket_bound(int i) { return 1e-4 * (1 << i); }
+
+	Metric(Type type, const char* name, const char* help,
+	       const char* label_name = 0, const char* label_value = 0);
+
+	void add(uint64_t n = 1) { m_count.fetch_add(n, std::memory_order_relaxed); }
+	void set(double value)   { m_value.store(value, std::memory_order_relaxed); }
+	void observe(double seconds);
+
+	Type               type()        const { return m_type; }
+	const std::string& name()        const { return m_name; }
+	const std::string& help()        const { return m_help; }
+	const std::string& label_name()  const { return m_label_name; }
+	const std::string& label_value() const { return m_label_value; }
+	// The counter, or the number of observations of a histogram
+	uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+	// The gauge, or the sum of observations of a histogram
+	double   value() const;
+	uint64_t bucket_count(int i) const {
+		return m_buckets[i].load(std::memory_order_relaxed);
+	}
+
+private:
+	Type                  m_type;
+	std::string           m_name;
+	std::string           m_help;
+	std::string           m_label_name;
+	std::string           m_label_value;
+	std::atomic<uint64_t> m_count;
+	std::atomic<double>   m_value;
+	std::atomic<uint64_t> m_sum_ns;
+	std::atomic<uint64_t> m_buckets[BUCKET_COUNT + 1];
+};
+
+// Owns the metrics of a run and writes them out every interval seconds,
+//   as a Prometheus textfile if filename ends in .prom (replaced atomically,
+//   for node_exporter's textfile collector), otherwise as JSON lines
+// Note: Metrics must all be added before any are updated or exported
+class MetricsRegistry {
+public:
+	MetricsRegistry(const char* filename, double interval);
+
+	Metric* add_counter(const char* name, const char* help,
+	                    const char* label_name = 0, const char* label_value = 0);
+	Metric* add_gauge(const char* name, const char* help,
+	                  const char* label_name = 0, const char* label_value = 0);
+	Metric* add_histogram(const char* name, const char* help,
+	                      const char* label_name = 0, const char* label_value = 0);
+
+	void write_prometheus(std::ostream& out) const;
+	void write_json(std::ostream& out) const;
+
+	// Exports if interval seconds have passed since the last export
+	bool poll();
+	// Returns false if the file could not be written
+	bool write();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	std::vector<std::unique_ptr<Metric> > m_metrics;
+	std::string       m_filename;
+	bool              m_prometheus;
+	double            m_interval;
+	Clock::time_point m_last_write;
+};
+
+// Times the sections between start() and stop() into a histogram, as one
+//   observation of their total when recorded or destroyed
+// Note: Device work is not waited for, so this is the time the host spends
+//         in the section, including any implicit synchronisation
+// Does nothing, not even read the clock, when histogram is null
+class MetricTimer {
+public:
+	explicit MetricTimer(Metric* histogram = 0)
+		: m_histogram(histogram), m_total(0), m_running(false) {}
+	~MetricTimer() { record(); }
+
+	void start() {
+		if( m_histogram ) {
+			m_start = Clock::now();
+			m_running = true;
+		}
+	}
+	void stop() {
+		if( m_running ) {
+			m_total += std::chrono::duration<double>(Clock::now() - m_start).count();
+			m_running = false;
+		}
+	}
+	// Observes the total to date, if any, and starts a new one
+	void record() {
+		stop();
+		if( m_total > 0 ) {
+			m_histogram->observe(m_total);
+		}
+		m_total = 0;
+	}
+	// Seconds between starts and stops to date
+	double total() const { return m_total; }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	Metric*           m_histogram;
+	Clock::time_point m_start;
+	double            m_total;
+	bool              m_running;
+};
@@ -20,6 +20,9 @@ struct hd_params {
   int      verbosity;
   key_t    dada_id;        // Identifier for the psrdada shared memory buffer
   const char * sigproc_file;  // Name of sigproc filterbank file
+  // consecutive files of the observation, starting with sigproc_file
+  unsigned int num_sigproc_files;
+  char **      sigproc_files;
   bool     yield_cpu;      // Yield/spin the CPU to in/decrease GPU latency
   hd_size  ncpus;          // No. CPU cores to use
   hd_size  nsamps_gulp;    // No. samples to gulp into memory and process at once
@@ -53,10 +56,22 @@ struct hd_params {
   hd_size  cand_sep_time;   // Min separation between candidates (in samples)
   hd_size  cand_sep_filter; // Min separation between candidates (in filters)
   hd_size  cand_sep_dm;     // Min separation between candidates (in DM trials)
-  hd_size  cand_rfi_dm_cut; // Minimum DM for valid candidate
-  //hd_size  cand_min_members; // Minimum members for valid candidate
+  hd_float cand_rfi_dm_cut; // Minimum DM for valid candidate
+  hd_size  cand_min_members; // Minimum members for valid candidate
+  const char* cand_filter;  // Expression a candidate must satisfy to be kept
+  bool     cand_frontier;   // Hold open clusters over for the next gulp
+  bool     cand_text;       // Write a text .cand file per gulp instead of a log
+  bool     cand_dispatch_calibrate; // Time the grouping targets at startup
+  hd_size  cand_parallel_min; // Min giants to group with the host thread pool
+  hd_size  cand_device_min;   // Min giants to group on the device
   
   hd_float max_giant_rate; // Maximum allowed number of giants per minute
+  hd_size  giant_topk;          // Max giants kept per time/DM cell (0 == off)
+  hd_size  giant_topk_time;     // Time extent of a top-K cell (in samples)
+  hd_size  giant_topk_dm_block; // DM extent of a top-K cell (in trials)
+  hd_float storm_max_fraction; // Max fraction of DM trials per time bin (0 == off)
+  hd_size  storm_bin_width;    // Width of the storm time bins (in samples)
+  bool     storm_drop;         // Drop storm bins instead of collapsing them
   hd_size  min_tscrunch_width; // Filter width at which to begin tscrunching
 
   // coincidencer socket mode
@@ -66,6 +81,30 @@ struct hd_params {
   // swap channel ordering for negative DM searching
   bool fswap;
 
+  // map filterbank files and process gulps in place, instead of reading them
+  bool mmap_input;
+  // reads of filterbank files to keep in flight, 0 to read synchronously
+  unsigned int read_ahead;
+  // process gulps in place in the blocks of the psrdada ring buffer
+  bool dada_blocks;
+  // name of a shared memory ring to read from, e.g. written by fil2shm
+  const char * shm_name;
+  // samples and channels to add together as the input is read
+  unsigned int ingest_tscrunch;
+  unsigned int ingest_fscrunch;
+  // deliver the input at this multiple of real time, 0 for unpaced, and
+  //   report how far behind real time each gulp is; < 0 to read as normal
+  double replay_speed;
+  // file to record the input to, as SIGPROC filterbank
+  const char * record_file;
+  // file to write runtime metrics to every metrics_interval seconds, as a
+  //   Prometheus textfile if it ends in .prom, else as JSON lines
+  const char * metrics_file;
+  double metrics_interval;
+  // file to write a timeline of the pipeline's threads to when it is
+  //   destroyed, in the Chrome trace-event format
+  const char * trace_file;
+
   bool boxcar_renorm;     // Renormalise the time series after boxcar filtering
  
   // channel zapping
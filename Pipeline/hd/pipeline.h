@@ -19,6 +19,10 @@ hd_error hd_create_pipeline(hd_pipeline* pipeline, hd_params params);
 hd_error hd_execute(hd_pipeline pipeline,
                     const hd_byte* filterbank, hd_size nsamps, hd_size nbits,
                     hd_size first_idx, hd_size* nsamps_processed);
+// Groups and writes out any candidates still held for the next gulp, and
+//   waits for the candidate log to be written out
+// Note: Call this after the last hd_execute
+hd_error hd_flush(hd_pipeline pipeline);
 void     hd_destroy_pipeline(hd_pipeline pipeline);
 
 #ifdef __cplusplus
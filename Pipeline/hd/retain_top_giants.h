@@ -0,0 +1,24 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#pragma once
+
+#include "hd/types.h"
+#include "hd/error.h"
+#include "hd/candidate_table.h"
+
+// Keeps only the k brightest giants in each (time window, DM block) cell,
+//   where windows are time_window samples long and blocks are dm_block DM
+//   trials wide
+// Note: Applying this to a subset of the giants and then again to the
+//         union gives the same result as applying it once to the union
+// Note: The surviving giants are left sorted by cell, then by peak
+hd_error retain_top_giants(CandidateTable& d_giants,
+                           hd_size         k,
+                           hd_size         time_window,
+                           hd_size         dm_block,
+                           hd_size         dm_count);
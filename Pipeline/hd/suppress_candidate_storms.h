@@ -0,0 +1,28 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#pragma once
+
+#include "hd/types.h"
+#include "hd/error.h"
+#include "hd/candidate_table.h"
+
+// Finds time bins (of bin_width samples) in which giants from more than
+//   max_fraction of the dm_count DM trials coincide, as happens when
+//   broadband RFI survives cleaning, and removes their giants before they
+//   reach clustering.
+// If collapse is true, each flagged bin is replaced by a single summary
+//   giant: its brightest member, spanning all of the bin's giants and with
+//   their total member count. Otherwise flagged bins are dropped entirely.
+// Note: nsamps must exceed the largest giant sample index
+hd_error suppress_candidate_storms(CandidateTable& d_giants,
+                                   hd_size         nsamps,
+                                   hd_size         bin_width,
+                                   hd_size         dm_count,
+                                   hd_float        max_fraction,
+                                   bool            collapse,
+                                   hd_size*        flagged_bin_count);
@@ -0,0 +1,66 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#pragma once
+
+#include <atomic>
+
+#include <stdint.h>
+
+// Opt-in timeline of spans recorded by every thread of the pipeline, for
+//   writing in the Chrome trace-event format (chrome://tracing, Perfetto)
+// Each thread appends to its own buffer without locking; a buffer is kept
+//   when its thread exits and reused by the next new thread, so that the
+//   short-lived workers of successive gulps share a few timeline rows
+class Trace {
+public:
+	// Starts recording, with timestamps relative to now
+	static void enable();
+	static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+	// Names the calling thread's row in the timeline
+	static void name_thread(const char* name);
+	// Appends a span to the calling thread's buffer
+	// Note: name must be a string literal (or otherwise outlive the trace)
+	static void record(const char* name, int64_t begin_ns, int64_t end_ns,
+	                   int64_t dm_idx, int64_t filter_width);
+	// Nanoseconds since the trace was enabled
+	static int64_t now();
+	// Writes out everything recorded, returning false on failure
+	// Note: No thread may be recording while this is called
+	static bool write(const char* filename);
+
+private:
+	static std::atomic<bool> s_enabled;
+};
+
+// Records the time between its construction and end() or destruction as a
+//   span, with the DM trial index and filter width it covers, if known
+// Does nothing, not even read the clock, unless tracing is enabled
+class TraceSpan {
+public:
+	explicit TraceSpan(const char* name, int64_t dm_idx = -1,
+	                   int64_t filter_width = -1)
+		: m_name(Trace::enabled() ? name : 0), m_dm_idx(dm_idx),
+		  m_filter_width(filter_width), m_begin(m_name ? Trace::now() : 0) {}
+	~TraceSpan() { end(); }
+
+	void end() {
+		if( m_name ) {
+			Trace::record(m_name, m_begin, Trace::now(), m_dm_idx, m_filter_width);
+			m_name = 0;
+		}
+	}
+
+private:
+	TraceSpan(const TraceSpan&);
+	TraceSpan& operator=(const TraceSpan&);
+
+	const char* m_name;
+	int64_t     m_dm_idx;
+	int64_t     m_filter_width;
+	int64_t     m_begin;
+};
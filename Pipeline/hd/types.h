@@ -13,26 +13,30 @@ typedef unsigned char         hd_byte;
 typedef size_t                hd_size;
 //typedef unsigned int          hd_size;
 typedef float                 hd_float;
+// Note: Used for per-gulp candidate quantities (sample offsets relative to
+//         the start of the gulp, filter/DM indices, member counts), which
+//         always fit in 32 bits.
+typedef unsigned int          hd_index;
 typedef struct hd_pipeline_t* hd_pipeline;
 
 // Fundamental candidate quantities only
 struct RawCandidates {
 	hd_float* peaks;
-	hd_size*  inds;
-	hd_size*  begins;
-	hd_size*  ends;
-	hd_size*  filter_inds;
-	hd_size*  dm_inds;
-	hd_size*  members;
+	hd_index* inds;
+	hd_index* begins;
+	hd_index* ends;
+	hd_index* filter_inds;
+	hd_index* dm_inds;
+	hd_index* members;
 };
 struct ConstRawCandidates {
 	const hd_float* peaks;
-	const hd_size*  inds;
-	const hd_size*  begins;
-	const hd_size*  ends;
-	const hd_size*  filter_inds;
-	const hd_size*  dm_inds;
-	const hd_size*  members;
+	const hd_index* inds;
+	const hd_index* begins;
+	const hd_index* ends;
+	const hd_index* filter_inds;
+	const hd_index* dm_inds;
+	const hd_index* members;
 };
 // Full candidate info including derived quantities
 struct Candidates : public RawCandidates {
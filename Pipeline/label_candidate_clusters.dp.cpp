@@ -15,9 +15,15 @@
 #include "hd/label_candidate_clusters.h"
 #include "hd/are_coincident.dp.hpp"
 #include "hd/utils.hpp"
+#include "hd/ThreadPool.h"
 
 #include <boost/iterator/counting_iterator.hpp>
 #include <sycl/algorithm/iota.hpp>
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <numeric>
+#include <vector>
 
 /*
 // Lexicographically projects 3D integer coordinates onto a 1D coordinate
@@ -93,110 +99,191 @@ struct range_min_functor : public thrust::binary_function<void,void,ValueType> {
 	}
 };
 */
-/* DPCT_ORIG __device__ unsigned int d_counter;*/
-// dpct::global_memory<unsigned int, 0> d_counter;
-// TODO: check if this can work
-// unsigned int* d_counter_ptr = nullptr;
+// Note: Giants are binned into a grid of (filter, DM cell) buckets and kept
+//         sorted by time within each bucket, all packed into a single key.
+//         The DM cell width is dm_tol, so all DM neighbours of a giant lie
+//         within one cell either side of its own.
+enum {
+	CLUSTER_TIME_BITS = 36,
+	CLUSTER_DM_BITS   = 22,
+	CLUSTER_FILTER_BITS = 6
+};
+typedef unsigned long long cluster_key;
 
-// Finds the root of a chain of equivalent labels
-//   E.g., 3->1, 4->3, 8->4, 5->8 => [1,3,4,5,8]->1
-// TODO: It would be quite interesting to study the behaviour of this
-//         algorithm/implementation in more detail.
-template<typename T>
-struct trace_equivalency_chain {
-	T* new_labels;
-    unsigned int* d_counter_ptr;
-	trace_equivalency_chain(T* new_labels_, unsigned int* d_counter_ptr_) : new_labels(new_labels_), d_counter_ptr(d_counter_ptr_) {}
-    inline /*__host__*/
-    void operator()(unsigned int old_label) const {
-        T cur_label = old_label;
-		while( new_labels[cur_label] != cur_label ) {
-			cur_label = new_labels[cur_label];
-			//new_labels[old_label] = cur_label;
-			// TESTING TODO: See if/how this varies if we write
-			//                 new_labels[old_label] each iteration vs.
-			//                 only at the end (see commented line below).
-			//               It appears to make only 10-20% difference
-            sycl::atomic<unsigned int>(sycl::global_ptr<unsigned int>(d_counter_ptr)).fetch_add(1);
-        }
-		new_labels[old_label] = cur_label;
-		
-		/*
-		T j = i;
-		while( new_labels[i] != j ) {
-			new_labels[i] = new_labels[j];
-		}
-		
-		
-		T j = i;
-		T new_label = new_labels[i] = new_labels[j];
-		while( new_label != j ) {
-			j = new_label;
-			//new_label = new_labels[j];
-			new_label = new_labels[i] = new_labels[j];
+inline cluster_key make_cluster_key(hd_size filter, hd_size dm_cell,
+                                    hd_size samp) {
+	return ((cluster_key)filter  << (CLUSTER_TIME_BITS + CLUSTER_DM_BITS)) |
+	       ((cluster_key)dm_cell <<  CLUSTER_TIME_BITS) |
+	        (cluster_key)samp;
+}
+
+struct cluster_key_functor {
+	const hd_index* d_samp_inds;
+	const hd_index* d_filters;
+	const hd_index* d_dms;
+	hd_size        dm_cell_width;
+	cluster_key_functor(const hd_index* d_samp_inds_, const hd_index* d_filters_,
+	                    const hd_index* d_dms_, hd_size dm_cell_width_)
+		: d_samp_inds(d_samp_inds_), d_filters(d_filters_), d_dms(d_dms_),
+		  dm_cell_width(dm_cell_width_) {}
+	inline cluster_key operator()(unsigned int i) const {
+		return make_cluster_key(d_filters[i], d_dms[i] / dm_cell_width,
+		                        d_samp_inds[i]);
+	}
+};
+
+// Atomic access to a label from device code
+typedef sycl::atomic_ref<hd_index, sycl::memory_order::relaxed,
+                         sycl::memory_scope::device,
+                         sycl::access::address_space::global_space> device_label_ref;
+// Atomic access to a label from host threads
+typedef std::atomic_ref<hd_index> host_label_ref;
+// Non-atomic stand-in with the same interface, for serial host execution
+struct serial_label_ref {
+	hd_index& label;
+	serial_label_ref(hd_index& label_) : label(label_) {}
+	inline hd_index load() const { return label; }
+	inline void     store(hd_index value) const { label = value; }
+	inline bool compare_exchange_strong(hd_index& expected,
+	                                    hd_index  desired) const {
+		if( label != expected ) {
+			expected = label;
+			return false;
 		}
-		// Note: This written value may subsequently be read by another thread,
-		//         which should improve the speed of the algorithm by exploiting
-		//         already-computed results.
-		new_labels[i] = new_label;
-		*/
+		label = desired;
+		return true;
 	}
 };
 
+// Lock-free union-find over d_labels
+// Note: Roots are always linked to the smaller of the two, so the final
+//         root of every component is its minimum index.
+template<typename LabelRef>
+inline hd_index union_find_root(hd_index* d_labels, hd_index i) {
+	hd_index parent = LabelRef(d_labels[i]).load();
+	while( parent != i ) {
+		i = parent;
+		parent = LabelRef(d_labels[i]).load();
+	}
+	return i;
+}
+
+template<typename LabelRef>
+inline void union_find_join(hd_index* d_labels, hd_index a, hd_index b) {
+	while( true ) {
+		a = union_find_root<LabelRef>(d_labels, a);
+		b = union_find_root<LabelRef>(d_labels, b);
+		if( a == b ) {
+			return;
+		}
+		if( a < b ) {
+			std::swap(a, b);
+		}
+		// Link the larger root under the smaller; retry if a was re-linked
+		hd_index expected = a;
+		if( LabelRef(d_labels[a]).compare_exchange_strong(expected, b) ) {
+			return;
+		}
+	}
+}
+
+template<typename LabelRef>
 struct cluster_functor {
-	hd_size  count;
-	const hd_size* d_samp_inds;
-	const hd_size* d_begins;
-	const hd_size* d_ends;
-	const hd_size* d_filters;
-	const hd_size* d_dms;
-	hd_size* d_labels;
-	hd_size  time_tol;
-	hd_size  filter_tol;
-	hd_size  dm_tol;
+	hd_size            count;
+	const cluster_key* d_keys;
+	const hd_index*    d_order;
+	const hd_index*    d_samp_inds;
+	const hd_index*    d_filters;
+	const hd_index*    d_dms;
+	hd_index*          d_labels;
+	hd_size            time_tol;
+	hd_size            filter_tol;
+	hd_size            dm_tol;
+	hd_size            dm_cell_width;
 	
 	cluster_functor(hd_size count_,
-	                const hd_size* d_samp_inds_,
-	                const hd_size* d_begins_, const hd_size* d_ends_,
-	                const hd_size* d_filters_, const hd_size* d_dms_,
-	                hd_size* d_labels_,
-	                hd_size time_tol_, hd_size filter_tol_, hd_size dm_tol_)
-		: count(count_),
+	                const cluster_key* d_keys_, const hd_index* d_order_,
+	                const hd_index* d_samp_inds_,
+	                const hd_index* d_filters_, const hd_index* d_dms_,
+	                hd_index* d_labels_,
+	                hd_size time_tol_, hd_size filter_tol_, hd_size dm_tol_,
+	                hd_size dm_cell_width_)
+		: count(count_), d_keys(d_keys_), d_order(d_order_),
 		  d_samp_inds(d_samp_inds_),
-		  d_begins(d_begins_), d_ends(d_ends_),
 		  d_filters(d_filters_), d_dms(d_dms_),
 		  d_labels(d_labels_),
-		  time_tol(time_tol_), filter_tol(filter_tol_), dm_tol(dm_tol_) {}
-
-    inline void operator()(unsigned int i) const {
-        hd_size samp_i   = d_samp_inds[i];
-		hd_size begin_i  = d_begins[i];
-		hd_size end_i    = d_ends[i];
+		  time_tol(time_tol_), filter_tol(filter_tol_), dm_tol(dm_tol_),
+		  dm_cell_width(dm_cell_width_) {}
+	
+	inline hd_size lower_bound(cluster_key key) const {
+		hd_size lo = 0, hi = count;
+		while( lo < hi ) {
+			hd_size mid = (lo + hi) / 2;
+			if( d_keys[mid] < key ) lo = mid + 1;
+			else                    hi = mid;
+		}
+		return lo;
+	}
+	
+	// Note: p is the position in key-sorted order
+	inline void operator()(unsigned int p) const {
+		hd_index i       = d_order[p];
+		hd_size samp_i   = d_samp_inds[i];
 		hd_size filter_i = d_filters[i];
 		hd_size dm_i     = d_dms[i];
-		// TODO: This would be much faster using shared mem like in nbody
-		for( unsigned int j=0; j<count; ++j ) {
-			if( j == i ) {
-				continue;
+		hd_size cell_i   = dm_i / dm_cell_width;
+		
+		// Within a bucket, coincidence reduces to the time test, and it is
+		//   sufficient to join each giant to its successor in time.
+		if( p+1 < count ) {
+			hd_index j = d_order[p+1];
+			if( d_filters[j] == filter_i && d_dms[j] / dm_cell_width == cell_i &&
+			    d_samp_inds[j] - samp_i <= (time_tol << filter_i) ) {
+				union_find_join<LabelRef>(d_labels, i, j);
+			}
+		}
+		
+		// Across buckets, search only those that sort after our own so that
+		//   each pair of buckets is examined once.
+		hd_size filter_lo = filter_i > filter_tol ? filter_i - filter_tol : 0;
+		hd_size filter_hi = filter_i + filter_tol;
+		hd_size cell_lo   = cell_i > 0 ? cell_i - 1 : 0;
+		hd_size cell_hi   = cell_i + 1;
+		for( hd_size f=filter_lo; f<=filter_hi; ++f ) {
+			hd_size tol = time_tol << std::max(filter_i, f);
+			hd_size samp_lo = samp_i > tol ? samp_i - tol : 0;
+			hd_size samp_hi = samp_i + tol;
+			for( hd_size c=cell_lo; c<=cell_hi; ++c ) {
+				if( f < filter_i || (f == filter_i && c <= cell_i) ) {
+					continue;
+				}
+				hd_size begin = lower_bound(make_cluster_key(f, c, samp_lo));
+				hd_size end   = lower_bound(make_cluster_key(f, c, samp_hi+1));
+				for( hd_size q=begin; q<end; ++q ) {
+					hd_index j = d_order[q];
+					if( are_coincident(samp_i, d_samp_inds[j],
+					                   0, 0, 0, 0,
+					                   filter_i, d_filters[j],
+					                   dm_i, d_dms[j],
+					                   time_tol, filter_tol, dm_tol) ) {
+						union_find_join<LabelRef>(d_labels, i, j);
+					}
+				}
 			}
-			hd_size samp_j   = d_samp_inds[j];
-			hd_size begin_j  = d_begins[j];
-			hd_size end_j    = d_ends[j];
-			hd_size filter_j = d_filters[j];
-			hd_size dm_j     = d_dms[j];
-			if( are_coincident(samp_i, samp_j,
-			                   begin_i, begin_j,
-			                   end_i, end_j,
-			                   filter_i, filter_j,
-			                   dm_i, dm_j,
-			                   time_tol, filter_tol, dm_tol) ) {
-				// Re-label as the minimum of the two
-                d_labels[i] = std::min(d_labels[i], d_labels[j]);
-            }
 		}
 	}
 };
 
+// Points every label directly at the root of its component
+template<typename LabelRef>
+struct flatten_labels_functor {
+	hd_index* d_labels;
+	flatten_labels_functor(hd_index* d_labels_) : d_labels(d_labels_) {}
+	inline void operator()(unsigned int i) const {
+		LabelRef(d_labels[i]).store(union_find_root<LabelRef>(d_labels, i));
+	}
+};
+
 // Finds components of the given list that are connected in time, filter and DM
 // Note: merge_dist is the distance in time up to which components are connected
 // Note: Merge distances in filter and DM space are currently fixed at 1
@@ -206,7 +293,7 @@ hd_error label_candidate_clusters(hd_size            count,
                                   hd_size            time_tol,
                                   hd_size            filter_tol,
                                   hd_size            dm_tol,
-                                  hd_size*           d_labels,
+                                  hd_index*          d_labels,
                                   hd_size*           label_count)
 {
 	/*
@@ -225,20 +312,41 @@ hd_error label_candidate_clusters(hd_size            count,
 	              ci.new_label = min(ci.new_label, cj.new_label);
 	 */
     
+	if( count == 0 ) {
+		*label_count = 0;
+		return HD_NO_ERROR;
+	}
 
-    heimdall::util::device_pointer<hd_size> d_labels_begin(d_labels);
+    heimdall::util::device_pointer<hd_index> d_labels_begin(d_labels);
     sycl::impl::iota(execution_policy,
                    d_labels_begin, d_labels_begin + count);
 
-    // This just does a brute-force O(N^2) search for neighbours and
-	//   re-labels as the minimum label over neighbours.
+    // Sort the giants into (filter, DM cell, time) order so that the
+	//   neighbours of each one can be found by binary search. Each giant is
+	//   then joined to its coincident neighbours with a parallel union-find.
+	hd_size dm_cell_width = std::max(dm_tol, (hd_size)1);
+	device_vector_wrapper<cluster_key> d_keys(count);
+	device_vector_wrapper<hd_index>    d_order(count);
+	sycl::impl::transform(execution_policy,
+	                      boost::iterators::make_counting_iterator<unsigned int>(0),
+	                      boost::iterators::make_counting_iterator<unsigned int>(count),
+	                      d_keys.begin(),
+	                      cluster_key_functor(d_cands.inds, d_cands.filter_inds,
+	                                          d_cands.dm_inds, dm_cell_width));
+	sycl::impl::iota(execution_policy, d_order.begin(), d_order.end());
+	sycl::impl::sort_by_key(execution_policy,
+	                        d_keys.begin(), d_keys.end(), d_order.begin(),
+	                        std::less());
+	cluster_key* d_keys_ptr  = heimdall::util::get_raw_pointer(&d_keys[0]);
+	hd_index*    d_order_ptr = heimdall::util::get_raw_pointer(&d_order[0]);
+	
     sycl::impl::for_each(execution_policy,
                   boost::iterators::make_counting_iterator<unsigned int>(0),
                   boost::iterators::make_counting_iterator<unsigned int>(count),
-                  cluster_functor(count, d_cands.inds, d_cands.begins,
-                                  d_cands.ends, d_cands.filter_inds,
+                  cluster_functor<device_label_ref>(count, d_keys_ptr, d_order_ptr,
+                                  d_cands.inds, d_cands.filter_inds,
                                   d_cands.dm_inds, d_labels, time_tol,
-                                  filter_tol, dm_tol));
+                                  filter_tol, dm_tol, dm_cell_width));
     /*
 	using thrust::make_transform_iterator;
 	using thrust::make_zip_iterator;
@@ -354,22 +462,12 @@ hd_error label_candidate_clusters(hd_size            count,
 		             d_labels_begin);
 	}
 	*/
-	// Finally, trace equivalency chains to find the final labels
-	// Note: This is a parallel version of this algorithm that may not be
-	//         as efficient as the sequential version but should win out
-	//         in overall speed.
-
-	unsigned int* d_counter_address = reinterpret_cast<unsigned int *>(sycl::malloc_shared(1 * sizeof(unsigned int), execution_policy.get_queue()));
-    // *((void **)&d_counter_address) = d_counter.get_ptr();
-    unsigned int* d_counter_ptr(d_counter_address);
-    *d_counter_ptr = 0;
-
+	// Finally, flatten the union-find forest so that each label is its
+	//   component's root (the minimum index in the component)
     sycl::impl::for_each(execution_policy,
                   boost::iterators::make_counting_iterator<unsigned int>(0),
                   boost::iterators::make_counting_iterator<unsigned int>(count),
-                  trace_equivalency_chain<hd_size>(d_labels, d_counter_ptr));
-
-    //std::cout << "Total chain iterations: " << *d_counter_ptr << std::endl;
+                  flatten_labels_functor<device_label_ref>(d_labels));
 	
 	// Finally we do a quick count of the number of unique labels
 	//   This is efficiently achieved by checking where new labels are
@@ -377,11 +475,105 @@ hd_error label_candidate_clusters(hd_size            count,
     device_vector_wrapper<int> d_label_roots(count);
     sycl::impl::transform(execution_policy,
                    d_labels_begin, d_labels_begin + count,
-                   boost::iterators::make_counting_iterator<hd_size>(0),
-                   d_label_roots.begin(), std::equal_to<hd_size>());
+                   boost::iterators::make_counting_iterator<hd_index>(0),
+                   d_label_roots.begin(), std::equal_to<hd_index>());
     *label_count = sycl::impl::count_if(execution_policy,
             d_label_roots.begin(), d_label_roots.end(),
             std::identity(), std::plus());
 
     return HD_NO_ERROR;
 }
+
+// Calls f(i) for i in [0,count), split into nchunks contiguous ranges that
+//   are run on pool (or inline when there is no pool)
+template<typename Func>
+static void host_for_each(ThreadPool* pool, hd_size nchunks, hd_size count,
+                          const Func& f) {
+	if( !pool || nchunks <= 1 ) {
+		for( hd_size i=0; i<count; ++i ) {
+			f(i);
+		}
+		return;
+	}
+	hd_size chunk = (count - 1) / nchunks + 1;
+	std::vector<std::future<void> > done;
+	for( hd_size begin=0; begin<count; begin+=chunk ) {
+		hd_size end = std::min(begin + chunk, count);
+		done.push_back(pool->enqueue([&f, begin, end]() {
+			for( hd_size i=begin; i<end; ++i ) {
+				f(i);
+			}
+		}));
+	}
+	for( hd_size c=0; c<done.size(); ++c ) {
+		done[c].get();
+	}
+}
+
+template<typename LabelRef>
+static hd_size label_clusters_on_host(hd_size            count,
+                                      ConstRawCandidates h_cands,
+                                      hd_size            time_tol,
+                                      hd_size            filter_tol,
+                                      hd_size            dm_tol,
+                                      hd_index*          h_labels,
+                                      ThreadPool*        pool,
+                                      hd_size            nthreads)
+{
+	// Same (filter, DM cell, time) ordering as on the device
+	hd_size dm_cell_width = std::max(dm_tol, (hd_size)1);
+	cluster_key_functor make_key(h_cands.inds, h_cands.filter_inds,
+	                             h_cands.dm_inds, dm_cell_width);
+	std::vector<std::pair<cluster_key,hd_index> > sorted(count);
+	for( hd_size i=0; i<count; ++i ) {
+		sorted[i] = std::make_pair(make_key(i), (hd_index)i);
+	}
+	std::sort(sorted.begin(), sorted.end());
+	std::vector<cluster_key> keys(count);
+	std::vector<hd_index>    order(count);
+	for( hd_size p=0; p<count; ++p ) {
+		keys[p]  = sorted[p].first;
+		order[p] = sorted[p].second;
+	}
+	
+	std::iota(h_labels, h_labels + count, (hd_index)0);
+	host_for_each(pool, nthreads, count,
+	              cluster_functor<LabelRef>(count, &keys[0], &order[0],
+	                                        h_cands.inds, h_cands.filter_inds,
+	                                        h_cands.dm_inds, h_labels, time_tol,
+	                                        filter_tol, dm_tol, dm_cell_width));
+	host_for_each(pool, nthreads, count,
+	              flatten_labels_functor<LabelRef>(h_labels));
+	
+	hd_size label_count = 0;
+	for( hd_size i=0; i<count; ++i ) {
+		label_count += (h_labels[i] == i);
+	}
+	return label_count;
+}
+
+hd_error label_candidate_clusters_host(hd_size            count,
+                                       ConstRawCandidates h_cands,
+                                       hd_size            time_tol,
+                                       hd_size            filter_tol,
+                                       hd_size            dm_tol,
+                                       hd_index*          h_labels,
+                                       hd_size*           label_count,
+                                       ThreadPool*        pool,
+                                       hd_size            nthreads)
+{
+	if( count == 0 ) {
+		*label_count = 0;
+		return HD_NO_ERROR;
+	}
+	if( pool && nthreads > 1 ) {
+		*label_count = label_clusters_on_host<host_label_ref>(
+			count, h_cands, time_tol, filter_tol, dm_tol, h_labels,
+			pool, nthreads);
+	}
+	else {
+		*label_count = label_clusters_on_host<serial_label_ref>(
+			count, h_cands, time_tol, filter_tol, dm_tol, h_labels, 0, 1);
+	}
+	return HD_NO_ERROR;
+}
@@ -19,24 +19,27 @@
 // #include "hd/write_time_series.h"
 
 #include "hd/utils.hpp"
+#include "hd/bitpack.h"
 
 #include <boost/iterator/counting_iterator.hpp>
 #include <sycl/algorithm/transform.hpp>
+#include <vector>
 
-template <typename WordType>
-struct unpack_functor {
-        const WordType* in;
-	unsigned int    nbits;
-	unsigned int    chans_per_word;
-	WordType        bitmask;
-	unpack_functor(const WordType* in_, unsigned int nbits_)
-		: in(in_), nbits(nbits_),
-		  chans_per_word(sizeof(WordType)*8/nbits), bitmask((1<<nbits)-1) {}
+// Unpacks the spectra at the given sample offsets into a contiguous array
+template <int NBITS, typename WordType>
+struct unpack_spectra_functor {
+	const WordType*     in;
+	const unsigned int* times;
+	unsigned int        stride;
+	unsigned int        nchans;
+	unpack_spectra_functor(const WordType* in_, const unsigned int* times_,
+	                       unsigned int stride_, unsigned int nchans_)
+		: in(in_), times(times_), stride(stride_), nchans(nchans_) {}
 
-        inline float operator()(unsigned int c) const {
-                unsigned int w = c / chans_per_word;
-		unsigned int k = c % chans_per_word;
-		return (float)((in[w] >> (k*nbits)) & bitmask);
+	inline float operator()(unsigned int i) const {
+		unsigned int s = i / nchans;
+		unsigned int c = i % nchans;
+		return (float)heimdall::bitpack::sample<NBITS>(&in[times[s]*stride], c);
 	}
 };
 
@@ -91,17 +94,28 @@ hd_error measure_bandpass(const hd_byte* d_filterbank,
 	random_engine rng(seed);
 	uniform_int_distribution<unsigned int> distribution(0, nsamps-1);
 	// Extract spectrum_count sample spectra from the filterbank
+	// Note: The sample times are drawn on the host and all spectra are
+	//         unpacked in a single pass, specialised on nbits.
+	std::vector<unsigned int> h_times(spectrum_count);
 	for( hd_size i=0; i<spectrum_count; ++i ) {
 		//hd_size t = i * spectrum_stride; // Regular spacing
-		hd_size t = distribution(rng); // Uniform random sampling
-		WordType* d_in = (WordType*)&d_filterbank[t*stride];\
-        sycl::impl::transform(
-            execution_policy,
-            boost::iterators::make_counting_iterator<unsigned int>(0),
-            boost::iterators::make_counting_iterator<unsigned int>(nchans),
-            d_sample_spectra1.begin() + i * nchans,
-            unpack_functor<WordType>(d_in, nbits));
-        }
+		h_times[i] = distribution(rng); // Uniform random sampling
+	}
+	device_vector_wrapper<unsigned int> d_times(h_times.begin(), h_times.end());
+	const unsigned int* d_times_ptr = heimdall::util::get_raw_pointer(&d_times[0]);
+	const WordType*     d_in        = (const WordType*)d_filterbank;
+	bool supported = heimdall::bitpack::dispatch(nbits, [&](auto nbits_c) {
+		sycl::impl::transform(
+			execution_policy,
+			boost::iterators::make_counting_iterator<unsigned int>(0),
+			boost::iterators::make_counting_iterator<unsigned int>(spectrum_count*nchans),
+			d_sample_spectra1.begin(),
+			unpack_spectra_functor<decltype(nbits_c)::value, WordType>(
+				d_in, d_times_ptr, stride, nchans));
+	});
+	if( !supported ) {
+		return HD_INVALID_NBITS;
+	}
 	
 	// Compute the 'remedian' (recursive median) of the sample spectra
 	// Note: We do this instead of a proper median for performance and simplicity
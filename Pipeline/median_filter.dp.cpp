@@ -19,63 +19,38 @@
 #include <sycl/algorithm/transform.hpp>
 
 /*
-  Note: The implementations of median3-5 here can be derived from
-          'sorting networks'.
+  Note: The implementations of median3-5 here are derived from
+          'sorting networks'. They are written in terms of min/max only
+          so that they are free of branches and map directly onto vector
+          min/max instructions on both host and device backends.
  */
 
+// Compare-exchange: leaves min(a,b) in a and max(a,b) in b
+inline void sort2(float& a, float& b) {
+	float t = sycl::fmin(a, b);
+	b = sycl::fmax(a, b);
+	a = t;
+}
+
 inline float median3(float a, float b, float c) {
-        return a < b ? b < c ? b
-	                      : a < c ? c : a
-	             : a < c ? a
-	                     : b < c ? c : b;
+	sort2(a, b);
+	return sycl::fmax(a, sycl::fmin(b, c));
 }
 
 inline float median4(float a, float b, float c, float d) {
-        return a < c ? b < d ? a < b ? c < d ? 0.5f*(b+c) : 0.5f*(b+d)
-	                             : c < d ? 0.5f*(a+c) : 0.5f*(a+d)
-	                     : a < d ? c < b ? 0.5f*(d+c) : 0.5f*(b+d)
-	                             : c < b ? 0.5f*(a+c) : 0.5f*(a+b)
-	             : b < d ? c < b ? a < d ? 0.5f*(b+a) : 0.5f*(b+d)
-	                             : a < d ? 0.5f*(a+c) : 0.5f*(c+d)
-	                     : c < d ? a < b ? 0.5f*(d+a) : 0.5f*(b+d)
-	                             : a < b ? 0.5f*(a+c) : 0.5f*(c+b);
+	// Note: After sorting the pairs, the min of (a,c) and the max of (b,d)
+	//         are the extremes, leaving the two middle values.
+	sort2(a, b);
+	sort2(c, d);
+	return 0.5f*(sycl::fmax(a, c) + sycl::fmin(b, d));
 }
 
 inline float median5(float a, float b, float c, float d, float e) {
-    // Note: This wicked code is by 'DRBlaise' and was found here:
-	//         http://stackoverflow.com/a/2117018
-	return b < a ? d < c ? b < d ? a < e ? a < d ? e < d ? e : d
-                                                 : c < a ? c : a
-                                         : e < d ? a < d ? a : d
-                                                 : c < e ? c : e
-                                 : c < e ? b < c ? a < c ? a : c
-                                                 : e < b ? e : b
-                                         : b < e ? a < e ? a : e
-                                                 : c < b ? c : b
-                         : b < c ? a < e ? a < c ? e < c ? e : c
-                                                 : d < a ? d : a
-                                         : e < c ? a < c ? a : c
-                                                 : d < e ? d : e
-                                 : d < e ? b < d ? a < d ? a : d
-                                                 : e < b ? e : b
-                                         : b < e ? a < e ? a : e
-                                                 : d < b ? d : b
-                 : d < c ? a < d ? b < e ? b < d ? e < d ? e : d
-                                                 : c < b ? c : b
-                                         : e < d ? b < d ? b : d
-                                                 : c < e ? c : e
-                                 : c < e ? a < c ? b < c ? b : c
-                                                 : e < a ? e : a
-                                         : a < e ? b < e ? b : e
-                                                 : c < a ? c : a
-                         : a < c ? b < e ? b < c ? e < c ? e : c
-                                                 : d < b ? d : b
-                                         : e < c ? b < c ? b : c
-                                                 : d < e ? d : e
-                                 : d < e ? a < d ? b < d ? b : d
-                                                 : e < a ? e : a
-                                         : a < e ? b < e ? b : e
-                                                 : d < a ? d : a;
+	// Note: The min and max of (a,b,c,d) can never be the median of five,
+	//         so the median is that of e and the two middle values.
+	sort2(a, b);
+	sort2(c, d);
+	return median3(e, sycl::fmax(a, c), sycl::fmin(b, d));
 }
 
 struct median_filter3_kernel {
@@ -188,6 +163,20 @@ struct median_scrunch5_array_kernel {
 	}
 };
 
+// Fuses the absolute value into the first scrunch of the remedian, saving
+//   a full pass over the input (used by get_rms)
+struct median_scrunch5_abs_kernel {
+    const hd_float* in;
+	median_scrunch5_abs_kernel(const hd_float* in_)
+		: in(in_) {}
+
+    inline hd_float operator()(unsigned int i) const {
+		const hd_float* p = &in[5*i];
+		return median5(sycl::fabs(p[0]), sycl::fabs(p[1]), sycl::fabs(p[2]),
+		               sycl::fabs(p[3]), sycl::fabs(p[4]));
+	}
+};
+
 hd_error median_filter3(const hd_float* d_in,
                         hd_size         count,
                         hd_float*       d_out)
@@ -316,6 +305,39 @@ hd_error median_scrunch5_array(const hd_float* d_in,
     return HD_NO_ERROR;
 }
 
+// Equivalent to taking the absolute value of d_in followed by
+//   median_scrunch5, but in a single pass and without modifying d_in
+hd_error median_scrunch5_abs(const hd_float* d_in,
+                             hd_size         count,
+                             hd_float*       d_out)
+{
+    heimdall::util::device_pointer<const hd_float> d_in_begin(d_in);
+    heimdall::util::device_pointer<hd_float> d_out_begin(d_out);
+
+	if( count < 5 ) {
+		hd_float v[4];
+		for( hd_size i=0; i<count; ++i ) {
+			v[i] = sycl::fabs((hd_float)d_in_begin[i]);
+		}
+		switch( count ) {
+		case 1: *d_out_begin = v[0]; break;
+		case 2: *d_out_begin = 0.5f*(v[0] + v[1]); break;
+		case 3: *d_out_begin = median3(v[0], v[1], v[2]); break;
+		case 4: *d_out_begin = median4(v[0], v[1], v[2], v[3]); break;
+		}
+	}
+	else {
+		// Note: Truncating here is necessary
+		hd_size out_count = count / 5;
+		using boost::iterators::make_counting_iterator;
+        sycl::impl::transform(execution_policy,
+            make_counting_iterator<unsigned int>(0),
+            make_counting_iterator<unsigned int>(out_count),
+            d_out_begin, median_scrunch5_abs_kernel(d_in));
+	}
+	return HD_NO_ERROR;
+}
+
 template <typename T>
 struct mean2_functor {
     inline T operator()(T a, T b) const { return (T)0.5 * (a + b); }
@@ -424,3 +446,37 @@ hd_error linear_stretch(const hd_float* d_in,
 
     return HD_NO_ERROR;
 }
+
+// Evaluates the linear stretch on the fly for each group of 5 outputs so
+//   that the stretched array never needs to be materialised
+struct linear_stretch_scrunch5_functor {
+	linear_stretch_functor2 stretch;
+	linear_stretch_scrunch5_functor(const hd_float* in, unsigned in_size,
+	                                float step)
+		: stretch(in, in_size, step) {}
+
+    inline hd_float operator()(unsigned int i) const {
+		return median5(stretch(5*i+0), stretch(5*i+1), stretch(5*i+2),
+		               stretch(5*i+3), stretch(5*i+4));
+	}
+};
+
+// Equivalent to linear_stretch(d_in, in_count, tmp, stretch_count)
+//   followed by median_scrunch5(tmp, stretch_count, d_out)
+// Note: stretch_count must be at least 5
+hd_error linear_stretch_median_scrunch5(const hd_float* d_in,
+                                        hd_size         in_count,
+                                        hd_size         stretch_count,
+                                        hd_float*       d_out)
+{
+	using boost::iterators::make_counting_iterator;
+    heimdall::util::device_pointer<hd_float> d_out_begin(d_out);
+	// Note: Truncating here is necessary
+	hd_size out_count = stretch_count / 5;
+    sycl::impl::transform(execution_policy,
+        make_counting_iterator<unsigned int>(0),
+        make_counting_iterator<unsigned int>(out_count), d_out_begin,
+        linear_stretch_scrunch5_functor(d_in, in_count,
+                                        hd_float(stretch_count - 1) / (in_count - 1)));
+    return HD_NO_ERROR;
+}
@@ -18,181 +18,104 @@
 #include <sycl/algorithm/copy.hpp>
 #include <sycl/algorithm/iota.hpp>
 #include <sycl/algorithm/reduce_by_key.hpp>
-#include <ZipIterator.hpp>
 
-// modified for tuple incompatibility in algorithm implemention
-
-typedef heimdall::util::device_pointer<hd_float> float_iterator;
-typedef heimdall::util::device_pointer<hd_size> size_iterator;
-typedef heimdall::util::device_pointer<const hd_float> const_float_iterator;
-typedef heimdall::util::device_pointer<const hd_size> const_size_iterator;
-typedef std::tuple<hd_float, hd_size, hd_size, hd_size, hd_size, hd_size, hd_size> candidate_tuple;
+#include <vector>
 
 struct merge_candidates_functor {
-    float_iterator cand_peaks_begin;
-    // size_iterator  cand_inds_begin;
-    // size_iterator  cand_begins_begin;
-    // size_iterator  cand_ends_begin;
-    // size_iterator  cand_filter_inds_begin;
-    // size_iterator  cand_dm_inds_begin;
-    // size_iterator  cand_members_begin;
-    size_iterator  cand_members_out_begin;
-
-    merge_candidates_functor(float_iterator cand_peaks_begin_,
-                             // size_iterator  cand_inds_begin_,
-                             // size_iterator  cand_begins_begin_,
-                             // size_iterator  cand_ends_begin_,
-                             // size_iterator  cand_filter_inds_begin_,
-                             // size_iterator  cand_dm_inds_begin_,
-                             // size_iterator  cand_members_begin_,
-                             size_iterator  cand_members_out_begin_)
-        : cand_peaks_begin(cand_peaks_begin_),
-          // cand_inds_begin(cand_inds_begin_),
-          // cand_begins_begin(cand_begins_begin_),
-          // cand_ends_begin(cand_ends_begin_),
-          // cand_filter_inds_begin(cand_filter_inds_begin_),
-          // cand_dm_inds_begin(cand_dm_inds_begin_),
-          // cand_members_begin(cand_members_begin_),
-          cand_members_out_begin(cand_members_out_begin_) {}
-
-    inline hd_size operator()(const hd_size &i1,
-                              const hd_size &i2) const {
-
-        hd_float snr1 = *(cand_peaks_begin + i1);
-        // hd_size ind1 = *(cand_inds_begin + i1);
-        // hd_size begin1 = *(cand_begins_begin + i1);
-        // hd_size end1 = *(cand_ends_begin + i1);
-        // hd_size filter_ind1 = *(cand_filter_inds_begin + i1);
-        // hd_size dm_ind1 = *(cand_dm_inds_begin + i1);
-        hd_size members1 = *(cand_members_out_begin + i1);
-
-        hd_float snr2 = *(cand_peaks_begin + i2);
-        // hd_size ind2 = *(cand_inds_begin + i2);
-        // hd_size begin2 = *(cand_begins_begin + i2);
-        // hd_size end2 = *(cand_ends_begin + i2);
-        // hd_size filter_ind2 = *(cand_filter_inds_begin + i2);
-        // hd_size dm_ind2 = *(cand_dm_inds_begin + i2);
-        hd_size members2 = *(cand_members_out_begin + i2);
-
-        if (snr1 >= snr2) {
-            *(cand_members_out_begin + i1) = members1 + members2;
+    const hd_float* cand_peaks;
+    hd_index*       cand_members;
+
+    merge_candidates_functor(const hd_float* cand_peaks_,
+                             hd_index*       cand_members_)
+        : cand_peaks(cand_peaks_), cand_members(cand_members_) {}
+
+    // Note: The candidates are referred to by index so that only the
+    //         index of the brightest member needs to be carried through
+    //         the reduction; its other quantities are gathered afterwards.
+    inline hd_index operator()(const hd_index &i1,
+                               const hd_index &i2) const {
+        hd_index members = cand_members[i1] + cand_members[i2];
+        // TODO: gtools may instead take the min begin and max end
+        if (cand_peaks[i1] >= cand_peaks[i2]) {
+            cand_members[i1] = members;
             return i1;
-            // return std::make_tuple(
-            //     snr1, ind1,
-            //     //(begin1+begin2)/2,
-            //     //(end1+end2)/2,
-            //     // TODO: I think this is what gtools does
-            //     // min((int)begin1, (int)begin2),
-            //     // max((int)end1, (int)end2),
-            //     // TODO: But this may be better
-            //     begin1, end1, filter_ind1, dm_ind1,
-            //     members1 + members2);
         } else {
-            *(cand_members_out_begin + i2) = members1 + members2;
+            cand_members[i2] = members;
             return i2;
-            // return std::make_tuple(snr2, ind2,
-            //                        //(begin1+begin2)/2,
-            //                        //(end1+end2)/2,
-            //                        // min((int)begin1, (int)begin2),
-            //                        // max((int)end1, (int)end2),
-            //                        begin2, end2, filter_ind2,
-            //                        dm_ind2, members1 + members2);
         }
     }
 };
 
-hd_error merge_candidates(hd_size count,
-                          hd_size *d_labels,
-                          ConstRawCandidates d_cands,
-                          RawCandidates d_groups) {
-    size_iterator labels_begin(d_labels);
-
-    // TODO: fix for tuple not supporting non-const iterators
-    RawCandidates d_cands_non_const = *(reinterpret_cast<RawCandidates *>(&d_cands));
-    float_iterator cand_peaks_begin(d_cands_non_const.peaks);
-    size_iterator cand_inds_begin(d_cands_non_const.inds);
-    size_iterator cand_begins_begin(d_cands_non_const.begins);
-    size_iterator cand_ends_begin(d_cands_non_const.ends);
-    size_iterator cand_filter_inds_begin(d_cands_non_const.filter_inds);
-    size_iterator cand_dm_inds_begin(d_cands_non_const.dm_inds);
-    size_iterator cand_members_begin(d_cands_non_const.members);
-
-    float_iterator group_peaks_begin(d_groups.peaks);
-    size_iterator group_inds_begin(d_groups.inds);
-    size_iterator group_begins_begin(d_groups.begins);
-    size_iterator group_ends_begin(d_groups.ends);
-    size_iterator group_filter_inds_begin(d_groups.filter_inds);
-    size_iterator group_dm_inds_begin(d_groups.dm_inds);
-    size_iterator group_members_begin(d_groups.members);
+hd_error merge_candidates(hd_size         count,
+                          hd_index*       d_labels,
+                          CandidateTable& d_cands,
+                          CandidateTable& d_groups) {
+    if (count == 0) {
+        d_groups.clear();
+        return HD_NO_ERROR;
+    }
+    heimdall::util::device_pointer<hd_index> labels_begin(d_labels);
+    RawCandidates cands = d_cands.raw();
 
     // Sort by labels and remember permutation
-    device_vector_wrapper<hd_size> d_permutation(count),
-                                   d_permutation_out(count),
-                                   d_labels_out(count),
-                                   d_members_out(count);
+    device_vector_wrapper<hd_index> d_permutation(count),
+                                    d_permutation_out(count),
+                                    d_labels_out(count);
     sycl::impl::iota(execution_policy,
         d_permutation.begin(), d_permutation.end());
     sycl::impl::sort_by_key(execution_policy,
         labels_begin, labels_begin + count, d_permutation.begin(),
         std::less());
-    sycl::impl::copy(execution_policy, cand_members_begin, cand_members_begin + count, d_members_out.begin());
 
     // Merge giants into groups according to the label
+    // Note: Member counts are accumulated in place in d_cands.members
     size_t group_count = 
         sycl::impl::reduce_by_key(execution_policy,
             labels_begin, labels_begin + count,
             d_permutation.begin(),
             d_labels_out.begin(), // discard_iterator(), // keys output
             d_permutation_out.begin(),
-            std::equal_to<hd_size>(),
-            merge_candidates_functor(
-                cand_peaks_begin,
-                // cand_inds_begin,
-                // cand_begins_begin,
-                // cand_ends_begin,
-                // cand_filter_inds_begin,
-                // cand_dm_inds_begin,
-                // cand_members_begin,
-                d_members_out.begin()
-            )
+            std::equal_to<hd_index>(),
+            merge_candidates_functor(cands.peaks, cands.members)
         ).second - d_permutation_out.begin();
+
+    // Pull out the brightest member of each group (all columns at once)
+    d_cands.gather(heimdall::util::get_raw_pointer(&d_permutation_out[0]),
+                   group_count, d_groups);
     execution_policy.get_queue().wait_and_throw();
-    sycl::impl::copy(execution_policy,
-        boost::iterators::make_permutation_iterator(cand_peaks_begin, d_permutation_out.begin()),
-        boost::iterators::make_permutation_iterator(cand_peaks_begin, d_permutation_out.begin()) + group_count,
-        group_peaks_begin
-    );
-    sycl::impl::copy(execution_policy,
-        boost::iterators::make_permutation_iterator(cand_inds_begin, d_permutation_out.begin()),
-        boost::iterators::make_permutation_iterator(cand_inds_begin, d_permutation_out.begin()) + group_count,
-        group_inds_begin
-    );
-    sycl::impl::copy(execution_policy,
-        boost::iterators::make_permutation_iterator(cand_begins_begin, d_permutation_out.begin()),
-        boost::iterators::make_permutation_iterator(cand_begins_begin, d_permutation_out.begin()) + group_count,
-        group_begins_begin
-    );
-    sycl::impl::copy(execution_policy,
-        boost::iterators::make_permutation_iterator(cand_ends_begin, d_permutation_out.begin()),
-        boost::iterators::make_permutation_iterator(cand_ends_begin, d_permutation_out.begin()) + group_count,
-        group_ends_begin
-    );
-    sycl::impl::copy(execution_policy,
-        boost::iterators::make_permutation_iterator(cand_filter_inds_begin, d_permutation_out.begin()),
-        boost::iterators::make_permutation_iterator(cand_filter_inds_begin, d_permutation_out.begin()) + group_count,
-        group_filter_inds_begin
-    );
-    sycl::impl::copy(execution_policy,
-        boost::iterators::make_permutation_iterator(cand_dm_inds_begin, d_permutation_out.begin()),
-        boost::iterators::make_permutation_iterator(cand_dm_inds_begin, d_permutation_out.begin()) + group_count,
-        group_dm_inds_begin
-    );
-    sycl::impl::copy(execution_policy,
-        boost::iterators::make_permutation_iterator(d_members_out.begin(), d_permutation_out.begin()),
-        boost::iterators::make_permutation_iterator(d_members_out.begin(), d_permutation_out.begin()) + group_count,
-        group_members_begin
-    );
-    execution_policy.get_queue().wait_and_throw();
+
+    return HD_NO_ERROR;
+}
+
+hd_error merge_candidates_host(hd_size                   count,
+                               const hd_index*           h_labels,
+                               const HostCandidateTable& h_cands,
+                               HostCandidateTable&       h_groups) {
+    // Note: Each label is the minimum index in its cluster, so the root of
+    //         every cluster is visited before any of its other members
+    std::vector<hd_index> brightest(count), members(count), roots;
+    for (hd_size i = 0; i < count; ++i) {
+        hd_index root = h_labels[i];
+        if (root == i) {
+            brightest[i] = i;
+            members[i]   = h_cands.members[i];
+            roots.push_back(i);
+        } else {
+            members[root] += h_cands.members[i];
+            if (h_cands.peaks[i] > h_cands.peaks[brightest[root]]) {
+                brightest[root] = i;
+            }
+        }
+    }
+
+    std::vector<hd_index> map(roots.size());
+    for (hd_size g = 0; g < roots.size(); ++g) {
+        map[g] = brightest[roots[g]];
+    }
+    h_cands.gather(map.data(), map.size(), h_groups);
+    for (hd_size g = 0; g < roots.size(); ++g) {
+        h_groups.members[g] = members[roots[g]];
+    }
 
     return HD_NO_ERROR;
 }
@@ -19,6 +19,7 @@
 
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <numeric>
 #include <iostream>
 using std::cout;
@@ -28,6 +29,7 @@ using std::endl;
 #include <iomanip>
 #include <string>
 #include <fstream>
+#include <cstring>
 
 #include "hd/pipeline.h"
 #include "hd/maths.h"
@@ -39,31 +41,27 @@ using std::endl;
 #include "hd/find_giants.h"
 #include "hd/label_candidate_clusters.h"
 #include "hd/merge_candidates.h"
+#include "hd/candidate_table.h"
+#include "hd/candidate_dispatch.h"
+#include "hd/suppress_candidate_storms.h"
+#include "hd/retain_top_giants.h"
+#include "hd/candidate_frontier.h"
+#include "hd/candidate_filter.h"
 
 #include "hd/DataSource.h"
-#include "hd/ClientSocket.h"
-#include "hd/SocketException.h"
-#include "hd/stopwatch.h"         // For benchmarking
+#include "hd/CandidateLog.h"
+#include "hd/CandidateSender.h"
+#include "hd/metrics.h"           // For runtime metrics
+#include "hd/trace.h"             // For timelines of the pipeline threads
 //#include "hd/write_time_series.h" // For debugging
 #include "hd/utils.hpp"
 #include "hd/ThreadPool.h"
 
 #include <dedisp.h>
 
-//#define HD_BENCHMARK
-
-#ifdef HD_BENCHMARK
-  void start_timer(Stopwatch& timer) { timer.start(); }
-  void stop_timer(Stopwatch &timer) {
-   dpct::get_current_device().queues_wait_and_throw(); timer.stop();
-  }
-#else
-  void start_timer(Stopwatch& timer) { }
-  void stop_timer(Stopwatch& timer) { }
-#endif // HD_BENCHMARK
-
 #include <utility>
 #include <cmath>
+#include <chrono>
 
 sycl::sycl_execution_policy<> execution_policy;
 
@@ -75,6 +73,101 @@ template<typename T> using device_vector = device_vector_wrapper<T>;
 template<typename T, typename U>
 std::pair<T&,U&> tie(T& a, U& b) { return std::pair<T&,U&>(a,b); }
 
+// The metrics updated by the pipeline, all null unless metrics are enabled
+struct PipelineMetrics {
+  Metric* gulp_seconds;
+  Metric* memory_seconds;
+  Metric* clean_seconds;
+  Metric* dedisp_seconds;
+  Metric* copy_seconds;
+  Metric* baseline_seconds;
+  Metric* normalise_seconds;
+  Metric* filter_seconds;
+  Metric* giants_seconds;
+  Metric* candidates_seconds;
+
+  Metric* gulps;
+  Metric* samples;
+  Metric* input_bytes;
+  Metric* dedispersed_bytes;
+  Metric* device_copy_bytes;
+  Metric* giants;
+  Metric* candidates;
+  Metric* allocations;
+  Metric* allocated_bytes;
+
+  Metric* gulp_giants;
+  Metric* gulp_candidates;
+  Metric* zapped_sample_fraction;
+  Metric* zapped_channel_fraction;
+  Metric* realtime_factor;
+
+  PipelineMetrics() { memset(this, 0, sizeof(*this)); }
+
+  void add_to(MetricsRegistry& registry) {
+    const char* stage_help = "Seconds spent in each pipeline stage, per gulp "
+      "or, for the stages run per DM trial, per trial";
+    gulp_seconds = registry.add_histogram("heimdall_gulp_seconds",
+      "Seconds taken to process each gulp");
+    memory_seconds = registry.add_histogram("heimdall_stage_seconds",
+      stage_help, "stage", "memory");
+    clean_seconds = registry.add_histogram("heimdall_stage_seconds",
+      stage_help, "stage", "clean");
+    dedisp_seconds = registry.add_histogram("heimdall_stage_seconds",
+      stage_help, "stage", "dedisp");
+    copy_seconds = registry.add_histogram("heimdall_stage_seconds",
+      stage_help, "stage", "copy");
+    baseline_seconds = registry.add_histogram("heimdall_stage_seconds",
+      stage_help, "stage", "baseline");
+    normalise_seconds = registry.add_histogram("heimdall_stage_seconds",
+      stage_help, "stage", "normalise");
+    filter_seconds = registry.add_histogram("heimdall_stage_seconds",
+      stage_help, "stage", "filter");
+    giants_seconds = registry.add_histogram("heimdall_stage_seconds",
+      stage_help, "stage", "giants");
+    candidates_seconds = registry.add_histogram("heimdall_stage_seconds",
+      stage_help, "stage", "candidates");
+
+    gulps = registry.add_counter("heimdall_gulps_total",
+      "Gulps processed");
+    samples = registry.add_counter("heimdall_samples_total",
+      "Samples processed");
+    input_bytes = registry.add_counter("heimdall_input_bytes_total",
+      "Bytes of filterbank data passed to the pipeline, including overlaps");
+    dedispersed_bytes = registry.add_counter("heimdall_dedispersed_bytes_total",
+      "Bytes of dedispersed time series produced");
+    device_copy_bytes = registry.add_counter("heimdall_device_copy_bytes_total",
+      "Bytes of dedispersed time series copied to the device");
+    giants = registry.add_counter("heimdall_giants_total",
+      "Giants found");
+    candidates = registry.add_counter("heimdall_candidates_total",
+      "Candidates written");
+    allocations = registry.add_counter("heimdall_buffer_allocations_total",
+      "Times a pipeline buffer grew and was reallocated");
+    allocated_bytes = registry.add_counter("heimdall_buffer_allocated_bytes_total",
+      "Bytes allocated when pipeline buffers grew");
+
+    gulp_giants = registry.add_gauge("heimdall_gulp_giants",
+      "Giants found in the last gulp");
+    gulp_candidates = registry.add_gauge("heimdall_gulp_candidates",
+      "Candidates written for the last gulp");
+    zapped_sample_fraction = registry.add_gauge("heimdall_zapped_sample_fraction",
+      "Fraction of the last gulp's samples zapped as 0-DM RFI");
+    zapped_channel_fraction = registry.add_gauge("heimdall_zapped_channel_fraction",
+      "Fraction of channels killed in the last gulp");
+    realtime_factor = registry.add_gauge("heimdall_realtime_factor",
+      "Seconds of data processed per second between the last two gulps");
+  }
+
+  // Counts an allocation if a buffer grows from old_bytes to new_bytes
+  void count_growth(hd_size old_bytes, hd_size new_bytes) const {
+    if( allocations && new_bytes > old_bytes ) {
+      allocations->add();
+      allocated_bytes->add(new_bytes);
+    }
+  }
+};
+
 struct hd_pipeline_t {
   hd_params   params;
   dedisp_plan dedispersion_plan;
@@ -83,6 +176,23 @@ struct hd_pipeline_t {
   // Memory buffers used during pipeline execution
   std::vector<hd_byte>    h_clean_filterbank;
   host_vector<hd_byte>    h_dm_series;
+
+  // Candidate grouping is run on the host for small giant counts
+  std::unique_ptr<ThreadPool> candidate_pool;
+  CandidateDispatch           candidate_dispatch;
+  // Groups not satisfying this are dropped before they reach the host
+  CandidateFilter             candidate_filter;
+  // Clusters left open at the end of the previous gulp
+  CandidateFrontier           candidate_frontier;
+  hd_size                     processed_end;
+  // Binary candidate log for the observation, unless writing text files
+  std::unique_ptr<CandidateLogWriter> candidate_log;
+  // Persistent connection to the coincidencer, if one is used
+  std::unique_ptr<CandidateSender>    coincidencer;
+  // Runtime metrics, if they are written out
+  std::unique_ptr<MetricsRegistry>    metrics_registry;
+  PipelineMetrics                     metrics;
+  std::chrono::steady_clock::time_point last_execute_end;
   // Should be one every thread, not global
   //device_vector<hd_float> d_time_series;
   //device_vector<hd_float> d_filtered_series;
@@ -147,6 +257,37 @@ hd_error allocate_gpu(const hd_params params) {
   return HD_NO_ERROR;
 }
 
+// Converts the new giants' sample indices from the filtered (scrunched)
+//   time series to samples relative to the start of the gulp, and fills in
+//   their filter, DM and member columns, all in one pass.
+struct finalise_giants_functor {
+  RawCandidates giants;
+  hd_index      offset;
+  hd_index      scrunch;
+  hd_index      filter_idx;
+  hd_index      dm_idx;
+  finalise_giants_functor(RawCandidates giants_, hd_index offset_,
+                          hd_index scrunch_, hd_index filter_idx_,
+                          hd_index dm_idx_)
+    : giants(giants_), offset(offset_), scrunch(scrunch_),
+      filter_idx(filter_idx_), dm_idx(dm_idx_) {}
+  inline void operator()(unsigned int i) const {
+    giants.inds[i]        = (giants.inds[i]   + offset) * scrunch;
+    giants.begins[i]      = (giants.begins[i] + offset) * scrunch;
+    giants.ends[i]        = (giants.ends[i]   + offset) * scrunch;
+    giants.filter_inds[i] = filter_idx;
+    giants.dm_inds[i]     = dm_idx;
+    // Note: This could be used to track total member samples if desired
+    giants.members[i]     = 1;
+  }
+};
+
+// Returns the largest time tolerance (in samples) over which giants can be
+//   clustered together
+hd_size get_cand_horizon(const hd_params& params) {
+  return params.cand_sep_time * params.boxcar_max;
+}
+
 unsigned int get_filter_index(unsigned int filter_width) {
   // This function finds log2 of the 32-bit power-of-two number v
   unsigned int v = filter_width;
@@ -159,6 +300,109 @@ unsigned int get_filter_index(unsigned int filter_width) {
   return r;
 }
 
+// Writes the groups to the coincidencer or to a candidate file named after
+//   the gulp starting at first_idx
+// Note: Sample indices in h_groups are relative to origin
+hd_error write_candidates(hd_pipeline pl, hd_size first_idx, hd_size origin,
+                          const HostCandidateTable& h_groups) {
+  if( pl->params.verbosity >= 2 ) {
+    cout << "Writing output candidates, utc_start=" << pl->params.utc_start << endl;
+  }
+
+  char buffer[64];
+  time_t now = pl->params.utc_start + (time_t) (first_idx / pl->params.spectra_per_second);
+  strftime (buffer, 64, HD_TIMESTR, (struct tm*) gmtime(&now));
+
+  std::stringstream ss;
+  ss << std::setw(2) << std::setfill('0') << pl->params.beam+1;
+
+  if ( pl->coincidencer )
+  {
+    CandidateGulpHeader gulp;
+    gulp.utc_start        = pl->params.utc_start;
+    gulp.first_sample_utc = now;
+    gulp.first_sample     = first_idx;
+    gulp.beam             = pl->params.beam+1;
+    gulp.count            = h_groups.size();
+
+    std::vector<CandidateRecord> records(h_groups.size());
+    for (hd_size i=0; i<h_groups.size(); ++i )
+    {
+      hd_size samp_idx = origin + h_groups.inds[i];
+      records[i].snr      = h_groups.peaks[i];
+      records[i].time     = samp_idx * pl->params.dt;
+      records[i].dm       = h_groups.dms[i];
+      records[i].filter   = h_groups.filter_inds[i];
+      records[i].dm_trial = h_groups.dm_inds[i];
+      records[i].members  = h_groups.members[i];
+      records[i].samp     = samp_idx;
+      records[i].begin    = origin + h_groups.begins[i];
+      records[i].end      = origin + h_groups.ends[i];
+    }
+    if ( !pl->coincidencer->send(gulp, records.data()) )
+      cerr << "WARNING: Failed to send " << h_groups.size()
+           << " candidates to the coincidencer" << endl;
+  }
+  else if( pl->candidate_log )
+  {
+    // Note: The writer fails in the background, so this is the first we hear
+    if( pl->candidate_log->get_error() )
+      return throw_error(HD_FILE_WRITE_FAILED);
+
+    if( pl->params.verbosity >= 2 )
+      cout << "Logging " << h_groups.size() << " candidates" << endl;
+
+    CandidateColumns columns;
+    columns.resize(h_groups.size());
+    for( hd_size i=0; i<h_groups.size(); ++i ) {
+      columns.snr[i]      = h_groups.peaks[i];
+      columns.samp[i]     = origin + h_groups.inds[i];
+      columns.filter[i]   = h_groups.filter_inds[i];
+      columns.dm_trial[i] = h_groups.dm_inds[i];
+      columns.dm[i]       = h_groups.dms[i];
+      columns.members[i]  = h_groups.members[i];
+      columns.begin[i]    = origin + h_groups.begins[i];
+      columns.end[i]      = origin + h_groups.ends[i];
+    }
+    pl->candidate_log->append(first_idx, now, columns);
+  }
+  else
+  {
+    if( pl->params.verbosity >= 2 )
+      cout << "Output timestamp: " << buffer << endl;
+
+    std::string filename = std::string(pl->params.output_dir) + "/" + std::string(buffer) + "_" + ss.str() + ".cand";
+
+    if( pl->params.verbosity >= 2 )
+      cout << "Output filename: " << filename << endl;
+
+    std::ofstream cand_file(filename.c_str(), std::ios::out);
+    if( pl->params.verbosity >= 2 )
+      cout << "Dumping " << h_groups.size() << " candidates to " << filename << endl;
+
+    if (cand_file.good())
+    {
+      for( hd_size i=0; i<h_groups.size(); ++i ) {
+        hd_size samp_idx = origin + h_groups.inds[i];
+        cand_file << h_groups.peaks[i] << "\t"
+                  << samp_idx << "\t"
+                  << samp_idx * pl->params.dt << "\t"
+                  << h_groups.filter_inds[i] << "\t"
+                  << h_groups.dm_inds[i] << "\t"
+                  << h_groups.dms[i] << "\t"
+                  << h_groups.members[i] << "\t"
+                  << origin + h_groups.begins[i] << "\t"
+                  << origin + h_groups.ends[i] << "\t"
+                  << "\n";
+      }
+    }
+    else
+      cout << "Skipping dump due to bad file open on " << filename << endl;
+    cand_file.close();
+  }
+  return HD_NO_ERROR;
+}
+
 hd_error hd_create_pipeline(hd_pipeline* pipeline_, hd_params params) {
   // In sycl we should set GPU before creating device memory, otherwise the runtime often crash
   if( params.verbosity >= 2 ) {
@@ -170,6 +414,12 @@ hd_error hd_create_pipeline(hd_pipeline* pipeline_, hd_params params) {
     return throw_error(error);
   }
 
+  if( params.trace_file ) {
+    Trace::enable();
+    Trace::name_thread("main");
+  }
+  TraceSpan create_span("create_pipeline");
+
   *pipeline_ = 0;
   
   // Note: We use a smart pointer here to automatically clean up after errors
@@ -222,6 +472,99 @@ hd_error hd_create_pipeline(hd_pipeline* pipeline_, hd_params params) {
     }
   }
   
+  if( params.ncpus > 1 ) {
+    pipeline->candidate_pool.reset(new ThreadPool(params.ncpus));
+  }
+  pipeline->candidate_dispatch = CandidateDispatch(params.cand_parallel_min,
+                                                   params.cand_device_min);
+  if( params.cand_dispatch_calibrate ) {
+    if( params.verbosity >= 2 ) {
+      cout << "\tCalibrating candidate grouping..." << endl;
+    }
+    CandidateDispatch calibrated;
+    error = calibrate_candidate_dispatch(params,
+                                         dedisp_get_dm_list(pipeline->dedispersion_plan),
+                                         dedisp_get_dm_count(pipeline->dedispersion_plan),
+                                         pipeline->candidate_pool.get(),
+                                         &calibrated);
+    if( error == HD_NO_ERROR ) {
+      pipeline->candidate_dispatch = calibrated;
+    }
+    else {
+      cerr << "WARNING: Candidate grouping calibration failed ("
+           << hd_get_error_string(error) << "), using default thresholds" << endl;
+    }
+  }
+  if( params.verbosity >= 1 ) {
+    cout << "Grouping candidates on host threads from "
+         << pipeline->candidate_dispatch.parallel_min
+         << " giants, on the device from "
+         << pipeline->candidate_dispatch.device_min << " giants" << endl;
+  }
+  
+  pipeline->candidate_frontier.set_span(4 * get_cand_horizon(params));
+  pipeline->processed_end = 0;
+
+  if( params.metrics_file ) {
+    pipeline->metrics_registry.reset(new MetricsRegistry(params.metrics_file,
+                                                         params.metrics_interval));
+    pipeline->metrics.add_to(*pipeline->metrics_registry);
+    if( !pipeline->metrics_registry->write() ) {
+      return throw_error(HD_FILE_OPEN_FAILED);
+    }
+    if( params.verbosity >= 1 ) {
+      cout << "Writing metrics to " << params.metrics_file << " every "
+           << params.metrics_interval << " s" << endl;
+    }
+  }
+
+  bool use_coincidencer = params.coincidencer_host != NULL &&
+                          params.coincidencer_port != -1;
+  if( use_coincidencer ) {
+    pipeline->coincidencer.reset(new CandidateSender(params.coincidencer_host,
+                                                     params.coincidencer_port));
+  }
+  else if( !params.cand_text ) {
+    char buffer[64];
+    strftime(buffer, 64, HD_TIMESTR, (struct tm*) gmtime(&params.utc_start));
+    std::stringstream filename;
+    filename << params.output_dir << "/" << buffer << "_"
+             << std::setw(2) << std::setfill('0') << params.beam+1 << ".candlog";
+    CandidateLogHeader log_header = CandidateLogHeader();
+    log_header.beam      = params.beam;
+    log_header.utc_start = params.utc_start;
+    log_header.dt        = params.dt;
+    pipeline->candidate_log.reset(new CandidateLogWriter(filename.str().c_str(),
+                                                         log_header));
+    if( pipeline->candidate_log->get_error() ) {
+      return throw_error(HD_FILE_OPEN_FAILED);
+    }
+    if( params.verbosity >= 1 ) {
+      cout << "Logging candidates to " << filename.str() << endl;
+    }
+  }
+
+  std::string filter_message;
+  CandidateFilter& filter = pipeline->candidate_filter;
+  error = filter.compile(params.cand_filter, &filter_message);
+  if( error == HD_NO_ERROR && params.cand_rfi_dm_cut > 0 ) {
+    std::stringstream cut;
+    cut << "dm >= " << params.cand_rfi_dm_cut;
+    error = filter.require(cut.str().c_str(), &filter_message);
+  }
+  if( error == HD_NO_ERROR && params.cand_min_members > 1 ) {
+    std::stringstream cut;
+    cut << "members >= " << params.cand_min_members;
+    error = filter.require(cut.str().c_str(), &filter_message);
+  }
+  if( error != HD_NO_ERROR ) {
+    cerr << "ERROR: Invalid candidate filter: " << filter_message << endl;
+    return throw_error(error);
+  }
+  filter.set_observation(dedisp_get_dm_list(pipeline->dedispersion_plan),
+                         dedisp_get_dm_count(pipeline->dedispersion_plan),
+                         params.dt);
+  
   *pipeline_ = pipeline.release();
   
   if( params.verbosity >= 2 ) {
@@ -245,30 +588,30 @@ hd_error hd_execute(hd_pipeline pl,
                     hd_size first_idx, hd_size* nsamps_processed) {
   hd_error error = HD_NO_ERROR;
   
-  Stopwatch total_timer;
-  Stopwatch memory_timer;
-  Stopwatch clean_timer;
-  Stopwatch dedisp_timer;
-  Stopwatch communicate_timer;
-  Stopwatch copy_timer;
-  Stopwatch baseline_timer;
-  Stopwatch normalise_timer;
-  Stopwatch filter_timer;
-  Stopwatch coinc_timer;
-  Stopwatch giants_timer;
-  Stopwatch candidates_timer;
+  const PipelineMetrics& metrics = pl->metrics;
+  MetricTimer total_timer(metrics.gulp_seconds);
+  MetricTimer memory_timer(metrics.memory_seconds);
+  MetricTimer clean_timer(metrics.clean_seconds);
+  MetricTimer dedisp_timer(metrics.dedisp_seconds);
+  MetricTimer candidates_timer(metrics.candidates_seconds);
   
-  start_timer(total_timer);
+  total_timer.start();
+  TraceSpan gulp_span("gulp");
 
   execution_policy = sycl::sycl_execution_policy(dpct::get_default_queue());
   
-  start_timer(clean_timer);
+  clean_timer.start();
+  TraceSpan clean_span("clean");
   // Note: Filterbank cleaning must be done out-of-place
   hd_size nbytes = nsamps * pl->params.nchans * nbits / 8;
-  start_timer(memory_timer);
+  memory_timer.start();
+  TraceSpan clean_alloc_span("alloc_filterbank");
+  hd_size old_capacity = pl->h_clean_filterbank.capacity();
   pl->h_clean_filterbank.resize(nbytes);
+  metrics.count_growth(old_capacity, pl->h_clean_filterbank.capacity());
   std::vector<int>          h_killmask(pl->params.nchans, 1);
-  stop_timer(memory_timer);
+  memory_timer.stop();
+  clean_alloc_span.end();
   
   if( pl->params.verbosity >= 2 ) {
     cout << "\tCleaning 0-DM filterbank..." << endl;
@@ -287,6 +630,7 @@ hd_error hd_execute(hd_pipeline pl,
   }
   // Note: We only clean the narrowest zero-DM signals; otherwise we
   //         start removing real stuff from higher DMs.
+  hd_size nsamps_zapped = 0;
   error = clean_filterbank_rfi(pl->dedispersion_plan,
                                &h_filterbank[0],
                                nsamps,
@@ -300,7 +644,8 @@ hd_error hd_execute(hd_pipeline pl,
                                pl->params.rfi_min_beams,
                                pl->params.rfi_broad,
                                pl->params.rfi_narrow,
-                               1);//pl->params.boxcar_max);
+                               1,//pl->params.boxcar_max);
+                               &nsamps_zapped);
   if( error != HD_NO_ERROR ) {
     return throw_error(error);
   }
@@ -327,7 +672,8 @@ hd_error hd_execute(hd_pipeline pl,
   // TESTING
   //h_clean_filterbank.assign(h_filterbank, h_filterbank+nbytes);
   
-  stop_timer(clean_timer);
+  clean_timer.stop();
+  clean_span.end();
   
   if( pl->params.verbosity >= 3 ) {
     /*
@@ -411,26 +757,24 @@ hd_error hd_execute(hd_pipeline pl,
     cout << "\tAllocating memory for pipeline computations..." << endl;
   }
   
-  start_timer(memory_timer);
+  memory_timer.start();
+  TraceSpan series_alloc_span("alloc_dm_series");
   
+  hd_size old_dm_series_size = pl->h_dm_series.size();
   pl->h_dm_series.resize(series_stride * pl->params.dm_nbits/8 * dm_count);
+  metrics.count_growth(old_dm_series_size, pl->h_dm_series.size());
   //pl->d_time_series.resize(series_stride);
   //pl->d_filtered_series.resize(series_stride, 0);
   
-  stop_timer(memory_timer);
+  memory_timer.stop();
+  series_alloc_span.end();
   
   RemoveBaselinePlan          baseline_remover;
   GetRMSPlan                  rms_getter;
   MatchedFilterPlan<hd_float> matched_filter_plan;
   GiantFinder                 giant_finder;
 
-  device_vector_wrapper<hd_float> d_all_giant_peaks;
-  device_vector_wrapper<hd_size> d_all_giant_inds;
-  device_vector_wrapper<hd_size> d_all_giant_begins;
-  device_vector_wrapper<hd_size> d_all_giant_ends;
-  device_vector_wrapper<hd_size> d_all_giant_filter_inds;
-  device_vector_wrapper<hd_size> d_all_giant_dm_inds;
-  device_vector_wrapper<hd_size> d_all_giant_members;
+  CandidateTable d_all_giants;
 
   typedef heimdall::util::device_pointer<hd_float> dev_float_ptr;
   typedef heimdall::util::device_pointer<hd_size> dev_size_ptr;
@@ -449,12 +793,14 @@ hd_error hd_execute(hd_pipeline pl,
   dedisp_size        out_nbits = pl->params.dm_nbits;
   dedisp_size        out_stride = series_stride * out_nbits/8;
   unsigned           flags = 0;
-  start_timer(dedisp_timer);
+  dedisp_timer.start();
+  TraceSpan dedisp_span("dedisp");
   derror = dedisp_execute_adv(pl->dedispersion_plan, nsamps,
                               in, in_nbits, in_stride,
                               out, out_nbits, out_stride,
                               flags);
-  stop_timer(dedisp_timer);
+  dedisp_timer.stop();
+  dedisp_span.end();
   if( derror != DEDISP_NO_ERROR ) {
     return throw_dedisp_error(derror);
   }
@@ -472,43 +818,48 @@ hd_error hd_execute(hd_pipeline pl,
   // TESTING
   hd_size write_dm = 0;
   
-  bool too_many_giants = false;
+  // Note: Written by several worker threads
+  std::atomic<bool> too_many_giants(false);
+  // Size below which the merged giants are not re-pruned in top-K mode
+  hd_size all_giants_prune_size = 0;
   
   {
+  // Note: Ends after the thread pool has finished all the DM trials
+  TraceSpan search_span("search_dms");
   ThreadPool thread_pool(pl->params.ncpus);
   std::mutex m_mutex;
   // For each DM
   for( hd_size dm_idx=0; dm_idx<dm_count; ++dm_idx ) {
     auto inner_function = [dm_idx,
         &scrunch_factors, &nsamps_computed, &too_many_giants, &series_stride, &dm_list, &nsamps, &dm_count, &m_mutex, &pl,
-        &d_all_giant_peaks, &d_all_giant_inds, &d_all_giant_begins, &d_all_giant_ends, &d_all_giant_filter_inds, &d_all_giant_dm_inds, &d_all_giant_members,
-        &beam, &write_dm, &first_idx,
-        &copy_timer, &baseline_timer, &normalise_timer, &filter_timer, &giants_timer]() -> hd_error {
+        &d_all_giants, &all_giants_prune_size,
+        &beam, &write_dm, &first_idx, &metrics]() -> hd_error {
     hd_error error = HD_NO_ERROR;
+    Trace::name_thread("dm worker");
+    TraceSpan trial_span("dm_trial", dm_idx);
+    MetricTimer copy_timer(metrics.copy_seconds);
+    MetricTimer baseline_timer(metrics.baseline_seconds);
+    MetricTimer normalise_timer(metrics.normalise_seconds);
+    MetricTimer filter_timer(metrics.filter_seconds);
+    MetricTimer giants_timer(metrics.giants_seconds);
     thread_local RemoveBaselinePlan          baseline_remover;
     thread_local GetRMSPlan                  rms_getter;
     thread_local MatchedFilterPlan<hd_float> matched_filter_plan;
     thread_local GiantFinder                 giant_finder;
-    thread_local device_vector_wrapper<hd_float> d_giant_peaks;
-    thread_local device_vector_wrapper<hd_size>  d_giant_inds;
-    thread_local device_vector_wrapper<hd_size>  d_giant_begins;
-    thread_local device_vector_wrapper<hd_size>  d_giant_ends;
-    thread_local device_vector_wrapper<hd_size>  d_giant_filter_inds;
-    thread_local device_vector_wrapper<hd_size>  d_giant_dm_inds;
-    thread_local device_vector_wrapper<hd_size>  d_giant_members;
+    thread_local CandidateTable               d_giants;
     thread_local device_vector_wrapper<hd_float> d_time_series;
     thread_local device_vector_wrapper<hd_float> d_filtered_series;
-    d_giant_peaks.clear();
-    d_giant_inds.clear();
-    d_giant_begins.clear();
-    d_giant_ends.clear();
-    d_giant_filter_inds.clear();
-    d_giant_dm_inds.clear();
-    d_giant_members.clear();
+    d_giants.clear();
+    TraceSpan alloc_span("alloc_series", dm_idx);
+    metrics.count_growth(d_time_series.size() * sizeof(hd_float),
+                         series_stride * sizeof(hd_float));
+    metrics.count_growth(d_filtered_series.size() * sizeof(hd_float),
+                         series_stride * sizeof(hd_float));
     d_time_series.resize(series_stride);
     d_filtered_series.resize(series_stride);
     //sycl::sycl_execution_policy<> local_execution_policy(sycl::queue(execution_policy.get_queue()));
     sycl::impl::fill(execution_policy, d_filtered_series.begin(), d_filtered_series.end(), 0);
+    alloc_span.end();
 
     hd_size  cur_dm_scrunch = scrunch_factors[dm_idx];
     hd_size  cur_nsamps  = nsamps_computed / cur_dm_scrunch;
@@ -533,7 +884,8 @@ hd_error hd_execute(hd_pipeline pl,
 
     // Copy the time series to the device and convert to floats
     hd_size offset = dm_idx * series_stride * pl->params.dm_nbits/8;
-    start_timer(copy_timer);
+    copy_timer.start();
+    TraceSpan copy_span("copy", dm_idx);
     execution_policy.get_queue().prefetch(&pl->h_dm_series[offset], cur_nsamps * pl->params.dm_nbits / 8).wait();
     switch( pl->params.dm_nbits ) {
     case 8:
@@ -558,7 +910,11 @@ hd_error hd_execute(hd_pipeline pl,
     default:
       return HD_INVALID_NBITS;
     }
-    stop_timer(copy_timer);
+    copy_timer.stop();
+    copy_span.end();
+    if( metrics.device_copy_bytes ) {
+      metrics.device_copy_bytes->add(cur_nsamps * pl->params.dm_nbits / 8);
+    }
     
     // Remove the baseline
     // -------------------
@@ -566,11 +922,13 @@ hd_error hd_execute(hd_pipeline pl,
     hd_size nsamps_smooth = hd_size(pl->params.baseline_length /
                                     (2 * cur_dt));
     // Crop the smoothing length in case not enough samples
-    start_timer(baseline_timer);
+    baseline_timer.start();
+    TraceSpan baseline_span("baseline", dm_idx);
     
     // TESTING
     error = baseline_remover.exec(time_series, cur_nsamps, nsamps_smooth);
-    stop_timer(baseline_timer);
+    baseline_timer.stop();
+    baseline_span.end();
     if( error != HD_NO_ERROR ) {
       return throw_error(error);
     }
@@ -584,7 +942,8 @@ hd_error hd_execute(hd_pipeline pl,
     
     // Normalise
     // ---------
-    start_timer(normalise_timer);
+    normalise_timer.start();
+    TraceSpan normalise_span("normalise", dm_idx);
     hd_float rms = rms_getter.exec(time_series, cur_nsamps);
     sycl::impl::transform(
         execution_policy,
@@ -592,7 +951,8 @@ hd_error hd_execute(hd_pipeline pl,
         dpct::make_constant_iterator(hd_float(1.0) / rms),
         d_time_series.begin(),
         std::multiplies<hd_float>());
-    stop_timer(normalise_timer);
+    normalise_timer.stop();
+    normalise_span.end();
     
     if( beam == 0 && dm_idx == write_dm && first_idx == 0 ) {
       // TESTING
@@ -611,10 +971,12 @@ hd_error hd_execute(hd_pipeline pl,
     hd_size cur_filtered_offset = rel_boxcar_max / 2;
     
     // Create and prepare matched filtering operations
-    start_timer(filter_timer);
+    filter_timer.start();
+    TraceSpan prep_span("filter_prep", dm_idx);
     // Note: Filter width is relative to the current time resolution
     matched_filter_plan.prep(time_series, cur_nsamps, rel_boxcar_max);
-    stop_timer(filter_timer);
+    filter_timer.stop();
+    prep_span.end();
     // --------------------------
 
     hd_float *filtered_series = heimdall::util::get_raw_pointer(&d_filtered_series[0]);
@@ -645,7 +1007,8 @@ hd_error hd_execute(hd_pipeline pl,
       // Filter width relative to cur_dm_scrunch AND tscrunch
       hd_size rel_rel_filter_width = rel_filter_width / rel_tscrunch_width;
 
-      start_timer(filter_timer);
+      filter_timer.start();
+      TraceSpan filter_span("filter", dm_idx, filter_width);
       
       error = matched_filter_plan.exec(filtered_series,
                                        rel_filter_width,
@@ -688,7 +1051,8 @@ hd_error hd_execute(hd_pipeline pl,
             std::multiplies<hd_float>());
       }
 
-      stop_timer(filter_timer);
+      filter_timer.stop();
+      filter_span.end();
       
       if( beam == 0 && dm_idx == write_dm && first_idx == 0 &&
           filter_width == 8 ) {
@@ -698,13 +1062,14 @@ hd_error hd_execute(hd_pipeline pl,
         //                         cur_dt, "filtered.tim");
       }
       
-      hd_size prev_giant_count = d_giant_peaks.size();
+      hd_size prev_giant_count = d_giants.size();
       
       if( pl->params.verbosity >= 4 ) {
         cout << "Finding giants..." << endl;
       }
       
-      start_timer(giants_timer);
+      giants_timer.start();
+      TraceSpan giants_span("giants", dm_idx, filter_width);
 
       if( pl->params.verbosity >= 4 ) {
         cerr << "pl->params.cand_sep_time=" << pl->params.cand_sep_time << " rel_rel_filter_width=" << rel_rel_filter_width << endl;
@@ -715,55 +1080,37 @@ hd_error hd_execute(hd_pipeline pl,
                                 //pl->params.cand_sep_time,
                                 // Note: This was MB's recommendation
                                 pl->params.cand_sep_time * rel_rel_filter_width,
-                                d_giant_peaks,
-                                d_giant_inds,
-                                d_giant_begins,
-                                d_giant_ends);
+                                d_giants);
       
       if( error != HD_NO_ERROR ) {
         return throw_error(error);
       }
 
       // add this if to avoid crash (try to allocate 0-length buffer) when no giants found, and is also a minor optimize
-      if(prev_giant_count < d_giant_peaks.size()){
+      if(prev_giant_count < d_giants.size()){
       
         hd_size rel_cur_filtered_offset = (cur_filtered_offset /
                                            rel_tscrunch_width);
 
-        sycl::impl::transform(
-            execution_policy,
-            d_giant_inds.begin() + prev_giant_count, d_giant_inds.end(),
-            d_giant_inds.begin() + prev_giant_count,
-            /*first_idx +*/ [=](auto _1) {
-              return (_1 + rel_cur_filtered_offset) * cur_scrunch;
-        });
-        sycl::impl::transform(
-            execution_policy,
-            d_giant_begins.begin() + prev_giant_count, d_giant_begins.end(),
-            d_giant_begins.begin() + prev_giant_count,
-            /*first_idx +*/ [=](auto _1) {
-              return (_1 + rel_cur_filtered_offset) * cur_scrunch;
-        });
-        sycl::impl::transform(
+        sycl::impl::for_each(
             execution_policy,
-            d_giant_ends.begin() + prev_giant_count, d_giant_ends.end(),
-            d_giant_ends.begin() + prev_giant_count,
-            /*first_idx +*/ [=](auto _1) {
-              return (_1 + rel_cur_filtered_offset) * cur_scrunch;
-        });
-
-        d_giant_filter_inds.resize(d_giant_peaks.size(), filter_idx);
-        d_giant_dm_inds.resize(d_giant_peaks.size(), dm_idx);
-        // Note: This could be used to track total member samples if desired
-        d_giant_members.resize(d_giant_peaks.size(), 1);
+            boost::iterators::make_counting_iterator<unsigned int>(0),
+            boost::iterators::make_counting_iterator<unsigned int>(
+                d_giants.size() - prev_giant_count),
+            finalise_giants_functor(d_giants.raw(prev_giant_count),
+                                    rel_cur_filtered_offset, cur_scrunch,
+                                    filter_idx, dm_idx));
       }
       
-      stop_timer(giants_timer);
+      giants_timer.stop();
+      giants_span.end();
       
       // Bail if the candidate rate is too high
-      hd_size total_giant_count = d_giant_peaks.size();
+      // Note: In top-K mode the number of giants is bounded instead
+      hd_size total_giant_count = d_giants.size();
       hd_float data_length_mins = nsamps * pl->params.dt / 60.0;
-      if ( pl->params.max_giant_rate && ( total_giant_count / data_length_mins > pl->params.max_giant_rate ) ) {
+      if ( pl->params.max_giant_rate && !pl->params.giant_topk &&
+           ( total_giant_count / data_length_mins > pl->params.max_giant_rate ) ) {
         too_many_giants = true;
         float searched = ((float) dm_idx * 100) / (float) dm_count;
         cout << "WARNING: exceeded max giants/min, DM [" << dm_list[dm_idx] << "] space searched " << searched << "%" << endl;
@@ -771,25 +1118,34 @@ hd_error hd_execute(hd_pipeline pl,
       }
       
     } // End of filter width loop
+    if( pl->params.giant_topk ) {
+      error = retain_top_giants(d_giants, pl->params.giant_topk,
+                                pl->params.giant_topk_time,
+                                pl->params.giant_topk_dm_block, dm_count);
+      if( error != HD_NO_ERROR ) {
+        return throw_error(error);
+      }
+    }
     // gather giant info
     {
+      TraceSpan lock_span("wait_giants_lock", dm_idx);
       std::lock_guard lock(m_mutex);
-      auto old_size = d_all_giant_peaks.size();
-      auto new_size = old_size + d_giant_peaks.size();
-      d_all_giant_peaks.resize(new_size);
-      d_all_giant_inds.resize(new_size);
-      d_all_giant_begins.resize(new_size);
-      d_all_giant_ends.resize(new_size);
-      d_all_giant_filter_inds.resize(new_size);
-      d_all_giant_dm_inds.resize(new_size);
-      d_all_giant_members.resize(new_size);
-      sycl::impl::copy(execution_policy, d_giant_peaks.begin(), d_giant_peaks.end(), d_all_giant_peaks.begin() + old_size);
-      sycl::impl::copy(execution_policy, d_giant_inds.begin(), d_giant_inds.end(), d_all_giant_inds.begin() + old_size);
-      sycl::impl::copy(execution_policy, d_giant_begins.begin(), d_giant_begins.end(), d_all_giant_begins.begin() + old_size);
-      sycl::impl::copy(execution_policy, d_giant_ends.begin(), d_giant_ends.end(), d_all_giant_ends.begin() + old_size);
-      sycl::impl::copy(execution_policy, d_giant_filter_inds.begin(), d_giant_filter_inds.end(), d_all_giant_filter_inds.begin() + old_size);
-      sycl::impl::copy(execution_policy, d_giant_dm_inds.begin(), d_giant_dm_inds.end(), d_all_giant_dm_inds.begin() + old_size);
-      sycl::impl::copy(execution_policy, d_giant_members.begin(), d_giant_members.end(), d_all_giant_members.begin() + old_size);
+      lock_span.end();
+      TraceSpan merge_span("merge_giants", dm_idx);
+      d_all_giants.append(d_giants);
+      // Note: The threshold doubles after each prune so that the total
+      //         pruning work stays proportional to the number of giants
+      if( pl->params.giant_topk &&
+          d_all_giants.size() > all_giants_prune_size ) {
+        error = retain_top_giants(d_all_giants, pl->params.giant_topk,
+                                  pl->params.giant_topk_time,
+                                  pl->params.giant_topk_dm_block, dm_count);
+        if( error != HD_NO_ERROR ) {
+          return throw_error(error);
+        }
+        all_giants_prune_size = std::max(2 * d_all_giants.size(),
+                                         pl->params.giant_topk);
+      }
       //execution_policy.get_queue().wait_and_throw();
     }
     return HD_NO_ERROR;
@@ -798,254 +1154,141 @@ hd_error hd_execute(hd_pipeline pl,
   } // End of DM loop
   }
 
-  hd_size giant_count = d_all_giant_peaks.size();
+  if( pl->params.giant_topk ) {
+    error = retain_top_giants(d_all_giants, pl->params.giant_topk,
+                              pl->params.giant_topk_time,
+                              pl->params.giant_topk_dm_block, dm_count);
+    if( error != HD_NO_ERROR ) {
+      return throw_error(error);
+    }
+  }
+
+  hd_size giant_count = d_all_giants.size();
+  hd_size raw_giant_count = giant_count;
   if( pl->params.verbosity >= 2 ) {
     cout << "Giant count = " << giant_count << endl;
   }
-  
-  start_timer(candidates_timer);
 
-  std::vector<hd_float> h_group_peaks;
-  std::vector<hd_size> h_group_inds;
-  std::vector<hd_size> h_group_begins;
-  std::vector<hd_size> h_group_ends;
-  std::vector<hd_size> h_group_filter_inds;
-  std::vector<hd_size> h_group_dm_inds;
-  std::vector<hd_size> h_group_members;
-  std::vector<hd_float> h_group_dms;
+  // Collapse or drop time bins swamped by broadband RFI before clustering
+  if( pl->params.storm_max_fraction > 0 ) {
+    TraceSpan storm_span("suppress_storms");
+    hd_size storm_bin_count = 0;
+    error = suppress_candidate_storms(d_all_giants,
+                                      nsamps_computed,
+                                      pl->params.storm_bin_width,
+                                      dm_count,
+                                      pl->params.storm_max_fraction,
+                                      !pl->params.storm_drop,
+                                      &storm_bin_count);
+    if( error != HD_NO_ERROR ) {
+      return throw_error(error);
+    }
+    giant_count = d_all_giants.size();
+    if( storm_bin_count && pl->params.verbosity >= 1 ) {
+      cout << "Suppressed " << storm_bin_count << " storm bins, giant count = "
+           << giant_count << endl;
+    }
+  }
+  
+  candidates_timer.start();
+  TraceSpan candidates_span("candidates");
+
+  HostCandidateTable h_groups;
+
+  // Bring in the clusters left open by the previous gulp, and hold back
+  //   those of this gulp that the next one could still extend
+  // Note: This moves the giants' sample indices to be relative to cand_origin
+  hd_size       cand_origin = first_idx;
+  CandidateHold cand_hold;
+  if( pl->params.cand_frontier ) {
+    error = pl->candidate_frontier.merge_into(first_idx, d_all_giants);
+    if( error != HD_NO_ERROR ) {
+      return throw_error(error);
+    }
+    cand_origin = pl->candidate_frontier.origin();
+    cand_hold   = pl->candidate_frontier.hold(first_idx + *nsamps_processed,
+                                              get_cand_horizon(pl->params));
+    giant_count = d_all_giants.size();
+  }
+  pl->processed_end = first_idx + *nsamps_processed;
 
   //if (!too_many_giants)
   //{
-    device_vector_wrapper<hd_size> d_giant_labels(giant_count);
-    hd_size *d_giant_labels_ptr = heimdall::util::get_raw_pointer(&d_giant_labels[0]);
-
-    RawCandidates d_giants;
-    d_giants.peaks = heimdall::util::get_raw_pointer(&d_all_giant_peaks[0]);
-    d_giants.inds = heimdall::util::get_raw_pointer(&d_all_giant_inds[0]);
-    d_giants.begins = heimdall::util::get_raw_pointer(&d_all_giant_begins[0]);
-    d_giants.ends = heimdall::util::get_raw_pointer(&d_all_giant_ends[0]);
-    d_giants.filter_inds = heimdall::util::get_raw_pointer(&d_all_giant_filter_inds[0]);
-    d_giants.dm_inds = heimdall::util::get_raw_pointer(&d_all_giant_dm_inds[0]);
-    d_giants.members = heimdall::util::get_raw_pointer(&d_all_giant_members[0]);
-
-    hd_size filter_count = get_filter_index(pl->params.boxcar_max) + 1;
-
+    hd_exec_target target = pl->candidate_dispatch.select(giant_count);
     if( pl->params.verbosity >= 2 ) {
-      cout << "Grouping coincident candidates..." << endl;
+      cout << "Grouping coincident candidates ("
+           << hd_get_exec_target_string(target) << ")..." << endl;
     }
 
-    ConstRawCandidates * const_d_giants = (ConstRawCandidates *) &d_giants;
-  
-    hd_size label_count;
-    error = label_candidate_clusters(giant_count,
-                                     *const_d_giants,
-                                     pl->params.cand_sep_time,
-                                     pl->params.cand_sep_filter,
-                                     pl->params.cand_sep_dm,
-                                     d_giant_labels_ptr,
-                                     &label_count);
+    // Labels, merges and transfers the groups (with their DMs) to the host
+    TraceSpan group_span("group_candidates");
+    error = group_candidates(target,
+                             pl->candidate_pool.get(),
+                             pl->params.ncpus,
+                             d_all_giants,
+                             dm_list,
+                             pl->params.cand_sep_time,
+                             pl->params.cand_sep_filter,
+                             pl->params.cand_sep_dm,
+                             h_groups,
+                             pl->params.cand_frontier ? &cand_hold : 0,
+                             pl->params.cand_frontier ?
+                               &pl->candidate_frontier.held() : 0,
+                             &pl->candidate_filter,
+                             cand_origin);
     if( error != HD_NO_ERROR ) {
       return throw_error(error);
     }
-  
-    hd_size group_count = label_count;
+
+    group_span.end();
+
+    hd_size group_count = h_groups.size();
     if( pl->params.verbosity >= 2 ) {
       cout << "Candidate count = " << group_count << endl;
     }
-
-    device_vector_wrapper<hd_float> d_group_peaks(group_count);
-    device_vector_wrapper<hd_size> d_group_inds(group_count);
-    device_vector_wrapper<hd_size> d_group_begins(group_count);
-    device_vector_wrapper<hd_size> d_group_ends(group_count);
-    device_vector_wrapper<hd_size> d_group_filter_inds(group_count);
-    device_vector_wrapper<hd_size> d_group_dm_inds(group_count);
-    device_vector_wrapper<hd_size> d_group_members(group_count);
-
-    device_vector_wrapper<hd_float> d_group_dms(group_count);
-
-    RawCandidates d_groups;
-    d_groups.peaks = heimdall::util::get_raw_pointer(&d_group_peaks[0]);
-    d_groups.inds = heimdall::util::get_raw_pointer(&d_group_inds[0]);
-    d_groups.begins = heimdall::util::get_raw_pointer(&d_group_begins[0]);
-    d_groups.ends = heimdall::util::get_raw_pointer(&d_group_ends[0]);
-    d_groups.filter_inds = heimdall::util::get_raw_pointer(&d_group_filter_inds[0]);
-    d_groups.dm_inds = heimdall::util::get_raw_pointer(&d_group_dm_inds[0]);
-    d_groups.members = heimdall::util::get_raw_pointer(&d_group_members[0]);
-
-    merge_candidates(giant_count,
-                     d_giant_labels_ptr,
-                     *const_d_giants,
-                     d_groups);
-  
-    // Look up the actual DM of each group
-    device_vector_wrapper<hd_float> d_dm_list(dm_list, dm_list + dm_count);
-
-    sycl::impl::gather(execution_policy,
-                d_group_dm_inds.begin(), d_group_dm_inds.end(),
-                d_dm_list.begin(), d_group_dms.begin());
-
-    // Device to host transfer of candidates
-    // h_group_peaks = d_group_peaks;
-    heimdall::util::copy(d_group_peaks, h_group_peaks);
-    // h_group_inds = d_group_inds;
-    heimdall::util::copy(d_group_inds, h_group_inds);
-    // h_group_begins = d_group_begins;
-    heimdall::util::copy(d_group_begins, h_group_begins);
-    // h_group_ends = d_group_ends;
-    heimdall::util::copy(d_group_ends, h_group_ends);
-    // h_group_filter_inds = d_group_filter_inds;
-    heimdall::util::copy(d_group_filter_inds, h_group_filter_inds);
-    // h_group_dm_inds = d_group_dm_inds;
-    heimdall::util::copy(d_group_dm_inds, h_group_dm_inds);
-    // h_group_members = d_group_members;
-    heimdall::util::copy(d_group_members, h_group_members);
-    // h_group_dms = d_group_dms;
-    heimdall::util::copy(d_group_dms, h_group_dms);
-    //h_group_flags = d_group_flags;
-    //heimdall::util::copy(d_group_flags, h_group_flags);
   //}
   
-  if( pl->params.verbosity >= 2 ) {
-    cout << "Writing output candidates, utc_start=" << pl->params.utc_start << endl;
+  TraceSpan write_span("write_candidates");
+  error = write_candidates(pl, first_idx, cand_origin, h_groups);
+  if( error != HD_NO_ERROR ) {
+    return throw_error(error);
   }
-
-  char buffer[64];
-  time_t now = pl->params.utc_start + (time_t) (first_idx / pl->params.spectra_per_second);
-  strftime (buffer, 64, HD_TIMESTR, (struct tm*) gmtime(&now));
-
-  std::stringstream ss;
-  ss << std::setw(2) << std::setfill('0') << pl->params.beam+1;
-
-  std::ostringstream oss;
-
-  if ( pl->params.coincidencer_host != NULL && pl->params.coincidencer_port != -1 )
-  {
-    try 
-    {
-      ClientSocket client_socket ( pl->params.coincidencer_host, pl->params.coincidencer_port );
-
-      strftime (buffer, 64, HD_TIMESTR, (struct tm*) gmtime(&(pl->params.utc_start)));
-
-      oss <<  buffer << " ";
-
-      time_t now = pl->params.utc_start + (time_t) (first_idx / pl->params.spectra_per_second);
-      strftime (buffer, 64, HD_TIMESTR, (struct tm*) gmtime(&now));
-      oss << buffer << " ";
-
-      oss << first_idx << " ";
-      oss << ss.str() << " ";
-      oss << h_group_peaks.size() << endl;
-      client_socket << oss.str();
-      oss.flush();
-      oss.str("");
-
-      for (hd_size i=0; i<h_group_peaks.size(); ++i ) 
-      {
-        hd_size samp_idx = first_idx + h_group_inds[i];
-        oss << h_group_peaks[i] << "\t"
-                      << samp_idx << "\t"
-                      << samp_idx * pl->params.dt << "\t"
-                      << h_group_filter_inds[i] << "\t"
-                      << h_group_dm_inds[i] << "\t"
-                      << h_group_dms[i] << "\t"
-                      << h_group_members[i] << "\t"
-                      << first_idx + h_group_begins[i] << "\t"
-                      << first_idx + h_group_ends[i] << endl;
-
-        client_socket << oss.str();
-        oss.flush();
-        oss.str("");
-      }
-      // client_socket should close when it goes out of scope...
-    }
-    catch (SocketException& e )
-    {
-      std::cerr << "SocketException was caught:" << e.description() << "\n";
+  write_span.end();
+    
+  candidates_timer.stop();
+  candidates_span.end();
+  
+  total_timer.stop();
+  gulp_span.end();
+
+  if( pl->metrics_registry ) {
+    // Note: The wall time since the last gulp includes reading the input
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double wall_seconds = total_timer.total();
+    if( metrics.gulps->count() ) {
+      wall_seconds = std::chrono::duration<double>(now - pl->last_execute_end).count();
     }
-
-  }
-  else
-  {
-    if( pl->params.verbosity >= 2 )
-      cout << "Output timestamp: " << buffer << endl;
-
-    std::string filename = std::string(pl->params.output_dir) + "/" + std::string(buffer) + "_" + ss.str() + ".cand";
-
-    if( pl->params.verbosity >= 2 )
-      cout << "Output filename: " << filename << endl;
-
-    std::ofstream cand_file(filename.c_str(), std::ios::out);
-    if( pl->params.verbosity >= 2 )
-      cout << "Dumping " << h_group_peaks.size() << " candidates to " << filename << endl;
-
-    if (cand_file.good())
-    {
-      for( hd_size i=0; i<h_group_peaks.size(); ++i ) {
-        hd_size samp_idx = first_idx + h_group_inds[i];
-        cand_file << h_group_peaks[i] << "\t"
-                  << samp_idx << "\t"
-                  << samp_idx * pl->params.dt << "\t"
-                  << h_group_filter_inds[i] << "\t"
-                  << h_group_dm_inds[i] << "\t"
-                  << h_group_dms[i] << "\t"
-                  << h_group_members[i] << "\t"
-                  << first_idx + h_group_begins[i] << "\t"
-                  << first_idx + h_group_ends[i] << "\t"
-                  << "\n";
-      }
+    pl->last_execute_end = now;
+    metrics.gulps->add();
+    metrics.samples->add(*nsamps_processed);
+    metrics.input_bytes->add(nbytes);
+    metrics.dedispersed_bytes->add(pl->h_dm_series.size());
+    metrics.giants->add(raw_giant_count);
+    metrics.candidates->add(group_count);
+    metrics.gulp_giants->set(raw_giant_count);
+    metrics.gulp_candidates->set(group_count);
+    metrics.zapped_sample_fraction->set(double(nsamps_zapped) / nsamps);
+    metrics.zapped_channel_fraction->set(double(bad_chan_count) / pl->params.nchans);
+    if( wall_seconds > 0 ) {
+      metrics.realtime_factor->set(*nsamps_processed * pl->params.dt / wall_seconds);
     }
-    else
-      cout << "Skipping dump due to bad file open on " << filename << endl;
-    cand_file.close();
+    total_timer.record();
+    memory_timer.record();
+    clean_timer.record();
+    dedisp_timer.record();
+    candidates_timer.record();
+    pl->metrics_registry->poll();
   }
-    
-  stop_timer(candidates_timer);
-  
-  stop_timer(total_timer);
-
-#ifdef HD_BENCHMARK
-  if( pl->params.verbosity >= 1 )
-  {
-  cout << "Mem alloc time:          " << memory_timer.getTime() << endl;
-  cout << "0-DM cleaning time:      " << clean_timer.getTime() << endl;
-  cout << "Dedispersion time:       " << dedisp_timer.getTime() << endl;
-  cout << "Copy time:               " << copy_timer.getTime() << endl;
-  cout << "Baselining time:         " << baseline_timer.getTime() << endl;
-  cout << "Normalisation time:      " << normalise_timer.getTime() << endl;
-  cout << "Filtering time:          " << filter_timer.getTime() << endl;
-  cout << "Find giants time:        " << giants_timer.getTime() << endl;
-  cout << "Process candidates time: " << candidates_timer.getTime() << endl;
-  cout << "Total time:              " << total_timer.getTime() << endl;
-  }
-
-  hd_float time_sum = (memory_timer.getTime() +
-                       clean_timer.getTime() +
-                       dedisp_timer.getTime() +
-                       copy_timer.getTime() +
-                       baseline_timer.getTime() +
-                       normalise_timer.getTime() +
-                       filter_timer.getTime() +
-                       giants_timer.getTime() +
-                       candidates_timer.getTime());
-  hd_float misc_time = total_timer.getTime() - time_sum;
-  
-  /*
-  std::ofstream timing_file("timing.dat", std::ios::app);
-  timing_file << total_timer.getTime() << "\t"
-              << misc_time << "\t"
-              << memory_timer.getTime() << "\t"
-              << clean_timer.getTime() << "\t"
-              << dedisp_timer.getTime() << "\t"
-              << copy_timer.getTime() << "\t"
-              << baseline_timer.getTime() << "\t"
-              << normalise_timer.getTime() << "\t"
-              << filter_timer.getTime() << "\t"
-              << giants_timer.getTime() << "\t"
-              << candidates_timer.getTime() << endl;
-  timing_file.close();
-  */
-  
-#endif // HD_BENCHMARK
   
   if( too_many_giants ) {
     return HD_TOO_MANY_EVENTS;
@@ -1055,12 +1298,81 @@ hd_error hd_execute(hd_pipeline pl,
   }
 }
 
+// Waits for the candidate log to be written out, failing if any of it was lost
+hd_error close_candidate_log(hd_pipeline pl) {
+  if( !pl->candidate_log ) {
+    return HD_NO_ERROR;
+  }
+  pl->candidate_log->close();
+  if( pl->candidate_log->get_error() ) {
+    return throw_error(HD_FILE_WRITE_FAILED);
+  }
+  return HD_NO_ERROR;
+}
+
+hd_error hd_flush(hd_pipeline pl) {
+  if( !pl->params.cand_frontier || pl->candidate_frontier.held().empty() ) {
+    return close_candidate_log(pl);
+  }
+  execution_policy = sycl::sycl_execution_policy(dpct::get_default_queue());
+  TraceSpan flush_span("flush");
+
+  CandidateTable d_giants;
+  d_giants.swap(pl->candidate_frontier.held());
+  if( pl->params.verbosity >= 2 ) {
+    cout << "Flushing " << d_giants.size() << " held giants..." << endl;
+  }
+
+  HostCandidateTable h_groups;
+  hd_error error = group_candidates(pl->candidate_dispatch.select(d_giants.size()),
+                                    pl->candidate_pool.get(),
+                                    pl->params.ncpus,
+                                    d_giants,
+                                    dedisp_get_dm_list(pl->dedispersion_plan),
+                                    pl->params.cand_sep_time,
+                                    pl->params.cand_sep_filter,
+                                    pl->params.cand_sep_dm,
+                                    h_groups,
+                                    0, 0,
+                                    &pl->candidate_filter,
+                                    pl->candidate_frontier.origin());
+  if( error != HD_NO_ERROR ) {
+    return throw_error(error);
+  }
+  error = write_candidates(pl, pl->processed_end,
+                           pl->candidate_frontier.origin(), h_groups);
+  if( error != HD_NO_ERROR ) {
+    return throw_error(error);
+  }
+  if( pl->metrics.candidates ) {
+    pl->metrics.candidates->add(h_groups.size());
+  }
+  return close_candidate_log(pl);
+}
+
 void hd_destroy_pipeline(hd_pipeline pipeline) {
   if( pipeline->params.verbosity >= 2 ) {
     cout << "\tDeleting pipeline object..." << endl;
   }
   
   dedisp_destroy_plan(pipeline->dedispersion_plan);
+
+  // Note: Waits for the writer thread to finish off the log
+  if( pipeline->candidate_log ) {
+    pipeline->candidate_log->close();
+  }
+
+  if( pipeline->metrics_registry ) {
+    pipeline->metrics_registry->write();
+  }
+
+  if( pipeline->params.trace_file ) {
+    // Note: The pipeline's threads are all idle by now
+    if( Trace::write(pipeline->params.trace_file) &&
+        pipeline->params.verbosity >= 1 ) {
+      cout << "Wrote trace to " << pipeline->params.trace_file << endl;
+    }
+  }
   
   // Note: This assumes memory owned by pipeline cleans itself up
   if( pipeline ) {
@@ -17,6 +17,7 @@
 
 #include "hd/utils.hpp"
 #include <cmath>
+#include <algorithm>
 
 class RemoveBaselinePlan_impl {
         device_vector_wrapper<hd_float> buf1;
@@ -48,16 +49,27 @@ public:
 		hd_size nscrunches  = (hd_size)(log(count/sample_count)/log(5.));
         hd_size count_round = std::pow<double>(5., nscrunches) * sample_count;
 
-        buf1.resize(count_round);
-		buf2.resize(count_round/5);
+        // Note: The buffers swap roles below, so both must hold the largest
+		//         intermediate, including the extrapolated 2*sample_count+2.
+		hd_size buf_size = std::max(count_round/5, sample_count*2+2);
+        buf1.resize(buf_size);
+		buf2.resize(buf_size);
         hd_float *buf1_ptr = heimdall::util::get_raw_pointer(&buf1[0]);
         hd_float *buf2_ptr = heimdall::util::get_raw_pointer(&buf2[0]);
 
-        // First we re-sample to the rounded size
-		linear_stretch(d_data, count, buf1_ptr, count_round);
+        // First we re-sample to the rounded size, fusing the first scrunch
+		//   into the stretch so that count_round values never hit memory
+		hd_size size = count_round;
+		if( nscrunches > 0 ) {
+			linear_stretch_median_scrunch5(d_data, count, count_round, buf1_ptr);
+			size /= 5;
+		}
+		else {
+			linear_stretch(d_data, count, buf1_ptr, count_round);
+		}
 	
 		// Then we median scrunch until we reach the sample size
-		for( hd_size size=count_round; size>sample_count; size/=5 ) {
+		for( ; size>sample_count; size/=5 ) {
 			median_scrunch5(buf1_ptr, size, buf2_ptr);
 			std::swap(buf1_ptr, buf2_ptr);
 		}
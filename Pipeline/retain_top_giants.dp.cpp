@@ -0,0 +1,108 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#if __has_include(<sycl/sycl.hpp>)
+#include <sycl/sycl.hpp>
+#else
+#include <CL/sycl.hpp>
+#endif
+
+#include "hd/retain_top_giants.h"
+#include "hd/utils.hpp"
+
+#include <boost/iterator/counting_iterator.hpp>
+#include <sycl/algorithm/for_each.hpp>
+#include <sycl/algorithm/transform.hpp>
+#include <sycl/algorithm/copy_if.hpp>
+
+typedef unsigned long long topk_key;
+
+// Packs the cell into the high word and the inverted peak into the low word
+//   so that an ascending sort orders each cell from brightest to faintest
+// Note: Peaks are above the detection threshold and hence positive, and
+//         positive floats order the same as their bit patterns
+struct topk_key_functor {
+	ConstRawCandidates giants;
+	hd_size            time_window;
+	hd_size            dm_block;
+	hd_size            dm_block_count;
+	topk_key_functor(ConstRawCandidates giants_, hd_size time_window_,
+	                 hd_size dm_block_, hd_size dm_block_count_)
+		: giants(giants_), time_window(time_window_), dm_block(dm_block_),
+		  dm_block_count(dm_block_count_) {}
+	inline topk_key operator()(unsigned int i) const {
+		topk_key cell = (topk_key)(giants.inds[i] / time_window) * dm_block_count
+		              + giants.dm_inds[i] / dm_block;
+		unsigned int peak_bits = sycl::bit_cast<unsigned int>(giants.peaks[i]);
+		return (cell << 32) | (topk_key)(~peak_bits);
+	}
+};
+
+// Flags the first k entries of each cell in the sorted keys
+struct topk_keep_functor {
+	const topk_key* d_keys;
+	hd_size         k;
+	int*            d_keep;
+	topk_keep_functor(const topk_key* d_keys_, hd_size k_, int* d_keep_)
+		: d_keys(d_keys_), k(k_), d_keep(d_keep_) {}
+	inline void operator()(unsigned int i) const {
+		d_keep[i] = i < k || (d_keys[i-k] >> 32) != (d_keys[i] >> 32);
+	}
+};
+
+hd_error retain_top_giants(CandidateTable& d_giants,
+                           hd_size         k,
+                           hd_size         time_window,
+                           hd_size         dm_block,
+                           hd_size         dm_count)
+{
+	using boost::iterators::make_counting_iterator;
+	using heimdall::util::get_raw_pointer;
+
+	hd_size count = d_giants.size();
+	// No cell can hold more than k giants
+	if( count <= k ) {
+		return HD_NO_ERROR;
+	}
+	time_window = std::max(time_window, (hd_size)1);
+	dm_block    = std::max(dm_block,    (hd_size)1);
+	hd_size dm_block_count = (dm_count - 1) / dm_block + 1;
+
+	device_vector_wrapper<topk_key> d_keys(count);
+	sycl::impl::transform(execution_policy,
+	                      make_counting_iterator<unsigned int>(0),
+	                      make_counting_iterator<unsigned int>(count),
+	                      d_keys.begin(),
+	                      topk_key_functor(d_giants.raw(), time_window,
+	                                       dm_block, dm_block_count));
+	d_giants.sort_by_key(d_keys);
+
+	device_vector_wrapper<int>      d_keep(count);
+	device_vector_wrapper<hd_index> d_survivors(count);
+	sycl::impl::for_each(execution_policy,
+	                     make_counting_iterator<unsigned int>(0),
+	                     make_counting_iterator<unsigned int>(count),
+	                     topk_keep_functor(get_raw_pointer(&d_keys[0]), k,
+	                                       get_raw_pointer(&d_keep[0])));
+	hd_size survivor_count =
+		sycl::impl::copy_if(execution_policy,
+		                    make_counting_iterator<hd_index>(0),
+		                    make_counting_iterator<hd_index>(count),
+		                    d_keep.begin(), // the stencil
+		                    d_survivors.begin(),
+		                    std::identity())
+		- d_survivors.begin();
+	if( survivor_count == count ) {
+		return HD_NO_ERROR;
+	}
+
+	CandidateTable d_kept;
+	d_giants.gather(get_raw_pointer(&d_survivors[0]), survivor_count, d_kept);
+	d_giants.swap(d_kept);
+
+	return HD_NO_ERROR;
+}
@@ -0,0 +1,269 @@
+/***************************************************************************
+ *
+ *   Copyright (C) 2012 by Ben Barsdell and Andrew Jameson
+ *   Licensed under the Academic Free License version 2.1
+ *
+ ***************************************************************************/
+
+#if __has_include(<sycl/sycl.hpp>)
+#include <sycl/sycl.hpp>
+#else
+#include <CL/sycl.hpp>
+#endif
+
+#include "hd/suppress_candidate_storms.h"
+#include "hd/utils.hpp"
+
+#include <limits>
+#include <boost/iterator/counting_iterator.hpp>
+#include <sycl/algorithm/fill.hpp>
+#include <sycl/algorithm/for_each.hpp>
+#include <sycl/algorithm/copy_if.hpp>
+
+template<typename T>
+using device_ref = sycl::atomic_ref<T, sycl::memory_order::relaxed,
+                                    sycl::memory_scope::device,
+                                    sycl::access::address_space::global_space>;
+
+// Note: Each time bin has a bitset with one bit per DM trial, so that the
+//         occupancy counts distinct DMs rather than giants (several
+//         filters can fire at the same DM).
+enum { OCCUPANCY_WORD_BITS = 32 };
+typedef unsigned int occupancy_word;
+
+struct mark_occupancy_functor {
+	ConstRawCandidates giants;
+	occupancy_word*    d_bits;
+	hd_size            bin_width;
+	hd_size            words_per_bin;
+	mark_occupancy_functor(ConstRawCandidates giants_, occupancy_word* d_bits_,
+	                       hd_size bin_width_, hd_size words_per_bin_)
+		: giants(giants_), d_bits(d_bits_),
+		  bin_width(bin_width_), words_per_bin(words_per_bin_) {}
+	inline void operator()(unsigned int i) const {
+		hd_size bin = giants.inds[i] / bin_width;
+		hd_size dm  = giants.dm_inds[i];
+		occupancy_word* word = &d_bits[bin*words_per_bin +
+		                               dm / OCCUPANCY_WORD_BITS];
+		device_ref<occupancy_word>(*word).fetch_or(
+			occupancy_word(1) << (dm % OCCUPANCY_WORD_BITS));
+	}
+};
+
+struct flag_bins_functor {
+	const occupancy_word* d_bits;
+	int*                  d_flags;
+	hd_size               words_per_bin;
+	hd_size               max_dms;
+	flag_bins_functor(const occupancy_word* d_bits_, int* d_flags_,
+	                  hd_size words_per_bin_, hd_size max_dms_)
+		: d_bits(d_bits_), d_flags(d_flags_),
+		  words_per_bin(words_per_bin_), max_dms(max_dms_) {}
+	inline void operator()(unsigned int bin) const {
+		hd_size occupancy = 0;
+		for( hd_size w=0; w<words_per_bin; ++w ) {
+			occupancy += sycl::popcount(d_bits[bin*words_per_bin + w]);
+		}
+		d_flags[bin] = occupancy > max_dms;
+	}
+};
+
+// Accumulates the extent, member count and peak of each flagged bin
+struct summarise_bins_functor {
+	ConstRawCandidates giants;
+	const int*         d_flags;
+	hd_size            bin_width;
+	hd_float*          d_bin_peaks;
+	hd_index*          d_bin_begins;
+	hd_index*          d_bin_ends;
+	hd_index*          d_bin_members;
+	summarise_bins_functor(ConstRawCandidates giants_, const int* d_flags_,
+	                       hd_size bin_width_,
+	                       hd_float* d_bin_peaks_, hd_index* d_bin_begins_,
+	                       hd_index* d_bin_ends_, hd_index* d_bin_members_)
+		: giants(giants_), d_flags(d_flags_), bin_width(bin_width_),
+		  d_bin_peaks(d_bin_peaks_), d_bin_begins(d_bin_begins_),
+		  d_bin_ends(d_bin_ends_), d_bin_members(d_bin_members_) {}
+	inline void operator()(unsigned int i) const {
+		hd_size bin = giants.inds[i] / bin_width;
+		if( !d_flags[bin] ) {
+			return;
+		}
+		device_ref<hd_float>(d_bin_peaks[bin]).fetch_max(giants.peaks[i]);
+		device_ref<hd_index>(d_bin_begins[bin]).fetch_min(giants.begins[i]);
+		device_ref<hd_index>(d_bin_ends[bin]).fetch_max(giants.ends[i]);
+		device_ref<hd_index>(d_bin_members[bin]).fetch_add(giants.members[i]);
+	}
+};
+
+// Chooses the lowest-indexed giant with the bin's peak to represent it
+struct choose_representatives_functor {
+	ConstRawCandidates giants;
+	const int*         d_flags;
+	hd_size            bin_width;
+	const hd_float*    d_bin_peaks;
+	hd_index*          d_bin_reps;
+	choose_representatives_functor(ConstRawCandidates giants_,
+	                               const int* d_flags_, hd_size bin_width_,
+	                               const hd_float* d_bin_peaks_,
+	                               hd_index* d_bin_reps_)
+		: giants(giants_), d_flags(d_flags_), bin_width(bin_width_),
+		  d_bin_peaks(d_bin_peaks_), d_bin_reps(d_bin_reps_) {}
+	inline void operator()(unsigned int i) const {
+		hd_size bin = giants.inds[i] / bin_width;
+		if( d_flags[bin] && giants.peaks[i] == d_bin_peaks[bin] ) {
+			device_ref<hd_index>(d_bin_reps[bin]).fetch_min(i);
+		}
+	}
+};
+
+// Marks the giants to keep, writing each bin's summary into its
+//   representative when collapsing
+struct select_survivors_functor {
+	RawCandidates   giants;
+	const int*      d_flags;
+	hd_size         bin_width;
+	const hd_index* d_bin_reps;
+	const hd_index* d_bin_begins;
+	const hd_index* d_bin_ends;
+	const hd_index* d_bin_members;
+	int*            d_keep;
+	select_survivors_functor(RawCandidates giants_, const int* d_flags_,
+	                         hd_size bin_width_, const hd_index* d_bin_reps_,
+	                         const hd_index* d_bin_begins_,
+	                         const hd_index* d_bin_ends_,
+	                         const hd_index* d_bin_members_, int* d_keep_)
+		: giants(giants_), d_flags(d_flags_), bin_width(bin_width_),
+		  d_bin_reps(d_bin_reps_), d_bin_begins(d_bin_begins_),
+		  d_bin_ends(d_bin_ends_), d_bin_members(d_bin_members_),
+		  d_keep(d_keep_) {}
+	inline void operator()(unsigned int i) const {
+		hd_size bin = giants.inds[i] / bin_width;
+		if( !d_flags[bin] ) {
+			d_keep[i] = 1;
+		}
+		else if( d_bin_reps && d_bin_reps[bin] == i ) {
+			giants.begins[i]  = d_bin_begins[bin];
+			giants.ends[i]    = d_bin_ends[bin];
+			giants.members[i] = d_bin_members[bin];
+			d_keep[i] = 1;
+		}
+		else {
+			d_keep[i] = 0;
+		}
+	}
+};
+
+hd_error suppress_candidate_storms(CandidateTable& d_giants,
+                                   hd_size         nsamps,
+                                   hd_size         bin_width,
+                                   hd_size         dm_count,
+                                   hd_float        max_fraction,
+                                   bool            collapse,
+                                   hd_size*        flagged_bin_count)
+{
+	using boost::iterators::make_counting_iterator;
+	using heimdall::util::get_raw_pointer;
+
+	*flagged_bin_count = 0;
+	hd_size count   = d_giants.size();
+	hd_size max_dms = (hd_size)(max_fraction * dm_count);
+	// No bin can be flagged unless there are more giants than max_dms
+	if( count <= max_dms || bin_width == 0 ) {
+		return HD_NO_ERROR;
+	}
+
+	hd_size nbins         = nsamps / bin_width + 1;
+	hd_size words_per_bin = (dm_count - 1) / OCCUPANCY_WORD_BITS + 1;
+
+	// Histogram the distinct DMs in each time bin and flag the busy ones
+	device_vector_wrapper<occupancy_word> d_bits(nbins * words_per_bin);
+	device_vector_wrapper<int>            d_flags(nbins);
+	sycl::impl::fill(execution_policy, d_bits.begin(), d_bits.end(), 0);
+	sycl::impl::for_each(execution_policy,
+	                     make_counting_iterator<unsigned int>(0),
+	                     make_counting_iterator<unsigned int>(count),
+	                     mark_occupancy_functor(d_giants.raw(),
+	                                            get_raw_pointer(&d_bits[0]),
+	                                            bin_width, words_per_bin));
+	int* d_flags_ptr = get_raw_pointer(&d_flags[0]);
+	sycl::impl::for_each(execution_policy,
+	                     make_counting_iterator<unsigned int>(0),
+	                     make_counting_iterator<unsigned int>(nbins),
+	                     flag_bins_functor(get_raw_pointer(&d_bits[0]),
+	                                       d_flags_ptr,
+	                                       words_per_bin, max_dms));
+	*flagged_bin_count = sycl::impl::count_if(execution_policy,
+	                                          d_flags.begin(), d_flags.end(),
+	                                          std::identity(), std::plus());
+	if( *flagged_bin_count == 0 ) {
+		return HD_NO_ERROR;
+	}
+
+	// Summarise each flagged bin into its brightest giant
+	device_vector_wrapper<hd_float> d_bin_peaks;
+	device_vector_wrapper<hd_index> d_bin_begins;
+	device_vector_wrapper<hd_index> d_bin_ends;
+	device_vector_wrapper<hd_index> d_bin_members;
+	device_vector_wrapper<hd_index> d_bin_reps;
+	hd_index* d_bin_reps_ptr = 0;
+	if( collapse ) {
+		d_bin_peaks.resize(nbins);
+		d_bin_begins.resize(nbins);
+		d_bin_ends.resize(nbins);
+		d_bin_members.resize(nbins);
+		d_bin_reps.resize(nbins);
+		sycl::impl::fill(execution_policy, d_bin_peaks.begin(), d_bin_peaks.end(),
+		                 -std::numeric_limits<hd_float>::max());
+		sycl::impl::fill(execution_policy, d_bin_begins.begin(), d_bin_begins.end(),
+		                 std::numeric_limits<hd_index>::max());
+		sycl::impl::fill(execution_policy, d_bin_ends.begin(), d_bin_ends.end(), 0);
+		sycl::impl::fill(execution_policy, d_bin_members.begin(), d_bin_members.end(), 0);
+		sycl::impl::fill(execution_policy, d_bin_reps.begin(), d_bin_reps.end(),
+		                 std::numeric_limits<hd_index>::max());
+		d_bin_reps_ptr = get_raw_pointer(&d_bin_reps[0]);
+		sycl::impl::for_each(execution_policy,
+		                     make_counting_iterator<unsigned int>(0),
+		                     make_counting_iterator<unsigned int>(count),
+		                     summarise_bins_functor(d_giants.raw(), d_flags_ptr,
+		                                            bin_width,
+		                                            get_raw_pointer(&d_bin_peaks[0]),
+		                                            get_raw_pointer(&d_bin_begins[0]),
+		                                            get_raw_pointer(&d_bin_ends[0]),
+		                                            get_raw_pointer(&d_bin_members[0])));
+		sycl::impl::for_each(execution_policy,
+		                     make_counting_iterator<unsigned int>(0),
+		                     make_counting_iterator<unsigned int>(count),
+		                     choose_representatives_functor(d_giants.raw(),
+		                                                    d_flags_ptr, bin_width,
+		                                                    get_raw_pointer(&d_bin_peaks[0]),
+		                                                    d_bin_reps_ptr));
+	}
+
+	// Compact the surviving giants
+	device_vector_wrapper<int>      d_keep(count);
+	device_vector_wrapper<hd_index> d_survivors(count);
+	sycl::impl::for_each(execution_policy,
+	                     make_counting_iterator<unsigned int>(0),
+	                     make_counting_iterator<unsigned int>(count),
+	                     select_survivors_functor(d_giants.raw(), d_flags_ptr,
+	                                              bin_width, d_bin_reps_ptr,
+	                                              collapse ? get_raw_pointer(&d_bin_begins[0]) : 0,
+	                                              collapse ? get_raw_pointer(&d_bin_ends[0]) : 0,
+	                                              collapse ? get_raw_pointer(&d_bin_members[0]) : 0,
+	                                              get_raw_pointer(&d_keep[0])));
+	hd_size survivor_count =
+		sycl::impl::copy_if(execution_policy,
+		                    make_counting_iterator<hd_index>(0),
+		                    make_counting_iterator<hd_index>(count),
+		                    d_keep.begin(), // the stencil
+		                    d_survivors.begin(),
+		                    std::identity())
+		- d_survivors.begin();
+
+	CandidateTable d_kept;
+	d_giants.gather(get_raw_pointer(&d_survivors[0]), survivor_count, d_kept);
+	d_giants.swap(d_kept);
+
+	return HD_NO_ERROR;
+}
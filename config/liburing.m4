@@ -0,0 +1,44 @@
+dnl @synopsis SWIN_LIB_LIBURING
+dnl 
+AC_DEFUN([SWIN_LIB_LIBURING],
+[
+  AC_PROVIDE([SWIN_LIB_LIBURING])
+
+  AC_REQUIRE([SWIN_PACKAGE_OPTIONS])
+  SWIN_PACKAGE_OPTIONS([liburing])
+
+  AC_MSG_CHECKING([for liburing installation])
+
+  if test "$have_liburing" != "user disabled"; then
+
+    SWIN_PACKAGE_FIND([liburing],[liburing.h])
+    SWIN_PACKAGE_TRY_COMPILE([liburing],[#include <liburing.h>],
+                             [struct io_uring ring; io_uring_queue_init (1, &ring, 0);])
+
+    SWIN_PACKAGE_FIND([liburing],[liburing.*])
+    SWIN_PACKAGE_TRY_LINK([liburing],[#include <liburing.h>],
+                          [struct io_uring ring; io_uring_queue_init (1, &ring, 0);],
+                          [-luring])
+  fi
+
+  AC_MSG_RESULT([$have_liburing])
+
+  if test x"$have_liburing" = xyes; then
+
+    AC_DEFINE([HAVE_LIBURING],[1],
+              [Define if liburing is present])
+    [$1]
+
+  else
+    :
+    [$2]
+  fi
+
+  LIBURING_LIBS="$liburing_LIBS"
+  LIBURING_CFLAGS="$liburing_CFLAGS"
+
+  AC_SUBST(LIBURING_LIBS)
+  AC_SUBST(LIBURING_CFLAGS)
+  AM_CONDITIONAL(HAVE_LIBURING,[test "$have_liburing" = yes])
+
+])